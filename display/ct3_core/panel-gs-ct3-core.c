@@ -0,0 +1,2068 @@
+// SPDX-License-Identifier: MIT
+/*
+ * Code shared by the gs_panel based ct3 panel drivers.
+ *
+ * Copyright 2024 Google LLC
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#include <drm/drm_modeset_lock.h>
+#include <drm/drm_vblank.h>
+#include <linux/delay.h>
+#include <linux/firmware.h>
+#include <linux/gpio/consumer.h>
+#include <linux/hash.h>
+#include <linux/input.h>
+#include <linux/interrupt.h>
+#include <linux/kobject.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/of.h>
+#include <linux/percpu.h>
+#include <linux/poll.h>
+#include <linux/ratelimit.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/thermal.h>
+#include <linux/uaccess.h>
+
+#include "trace/panel_trace.h"
+
+#include "panel-gs-ct3.h"
+
+/* entries per CPU, must be a power of two */
+#define CT3_LOG_SIZE 128
+
+struct ct3_log_entry {
+	u64 ts_ns;
+	char dev[16];
+	u32 a;
+	u32 b;
+	u16 event;
+	u16 cpu;
+};
+
+struct ct3_log_cpu {
+	unsigned int head;
+	struct ct3_log_entry entries[CT3_LOG_SIZE];
+};
+
+static DEFINE_PER_CPU(struct ct3_log_cpu, ct3_log_cpus);
+
+static const char * const ct3_log_fmt[CT3_LOG_MAX] = {
+	[CT3_LOG_REFRESH] = "refresh %uHz idle %uHz",
+	[CT3_LOG_FREQ] = "change to %uHz op %uHz",
+	[CT3_LOG_FFC] = "hs_clk %u Mbps from %u Mbps",
+	[CT3_LOG_TE_TIMEOUT] = "TE timeout at %uHz after %uus",
+	[CT3_LOG_CMD_ERR] = "command 0x%02x failed (%d)",
+	[CT3_LOG_READ_ERR] = "read 0x%02x failed (%d)",
+	[CT3_LOG_TE_SYNC] = "TE phase %uus, advance %uus",
+};
+
+/**
+ * ct3_log - record a panel state transition
+ * @ctx: gs_panel struct
+ * @event: what happened
+ * @a: first event argument
+ * @b: second event argument
+ *
+ * Entries go to a ring of the current CPU without taking locks or formatting
+ * anything. They are formatted when read from debugfs ct3/log or dumped.
+ */
+void ct3_log(const struct gs_panel *ctx, enum ct3_log_event event, u32 a, u32 b)
+{
+	struct ct3_log_cpu *log;
+	struct ct3_log_entry *e;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	log = this_cpu_ptr(&ct3_log_cpus);
+	e = &log->entries[log->head++ & (CT3_LOG_SIZE - 1)];
+	e->ts_ns = ktime_get_ns();
+	strscpy(e->dev, dev_name(ctx->dev), sizeof(e->dev));
+	e->a = a;
+	e->b = b;
+	e->event = event;
+	e->cpu = smp_processor_id();
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL_GPL(ct3_log);
+
+static int ct3_log_cmp(const void *a, const void *b)
+{
+	const struct ct3_log_entry *ea = a, *eb = b;
+
+	if (ea->ts_ns == eb->ts_ns)
+		return 0;
+
+	return ea->ts_ns < eb->ts_ns ? -1 : 1;
+}
+
+/*
+ * copy the used entries of all CPUs, sorted by time. Entries written while
+ * copying may come out torn, which is fine for a diagnostic log.
+ */
+static struct ct3_log_entry *ct3_log_collect(size_t *count)
+{
+	struct ct3_log_entry *entries;
+	size_t n = 0;
+	int cpu, i;
+
+	entries = kvmalloc_array(num_possible_cpus() * CT3_LOG_SIZE, sizeof(*entries),
+				 GFP_KERNEL);
+	if (!entries)
+		return NULL;
+
+	for_each_possible_cpu(cpu) {
+		const struct ct3_log_cpu *log = per_cpu_ptr(&ct3_log_cpus, cpu);
+
+		for (i = 0; i < CT3_LOG_SIZE; i++) {
+			const struct ct3_log_entry *e = &log->entries[i];
+
+			if (READ_ONCE(e->ts_ns) && e->event < CT3_LOG_MAX)
+				entries[n++] = *e;
+		}
+	}
+
+	sort(entries, n, sizeof(*entries), ct3_log_cmp, NULL);
+	*count = n;
+
+	return entries;
+}
+
+static void ct3_log_format(const struct ct3_log_entry *e, char *buf, size_t len)
+{
+	u64 ts = e->ts_ns;
+	const u32 ns = do_div(ts, NSEC_PER_SEC);
+	int n;
+
+	n = scnprintf(buf, len, "[%5llu.%06u] cpu%u %.*s: ", ts, (u32)(ns / NSEC_PER_USEC), e->cpu,
+		      (int)sizeof(e->dev), e->dev);
+	scnprintf(buf + n, len - n, ct3_log_fmt[e->event], e->a, e->b);
+}
+
+static const char *ct3_log_dump_reason;
+
+static void ct3_log_dump_work(struct work_struct *work)
+{
+	struct ct3_log_entry *entries;
+	char line[96];
+	size_t n, i;
+
+	entries = ct3_log_collect(&n);
+	if (!entries)
+		return;
+
+	pr_info("ct3: event log dump (%s), %zu entries\n", READ_ONCE(ct3_log_dump_reason), n);
+	for (i = 0; i < n; i++) {
+		ct3_log_format(&entries[i], line, sizeof(line));
+		pr_info("ct3: %s\n", line);
+	}
+
+	kvfree(entries);
+}
+static DECLARE_WORK(ct3_log_dump_w, ct3_log_dump_work);
+
+/**
+ * ct3_log_dump - print the event log
+ * @reason: what went wrong, printed ahead of the entries, must stay valid
+ *
+ * Meant for panel errors and underruns, may be called from any context. The log
+ * is printed from a work item so that the caller doesn't pay for the printk, a few
+ * entries recorded after the error may show up as well. Dumps are rate limited.
+ */
+void ct3_log_dump(const char *reason)
+{
+	static DEFINE_RATELIMIT_STATE(rs, 10 * HZ, 1);
+
+	if (!__ratelimit(&rs))
+		return;
+
+	WRITE_ONCE(ct3_log_dump_reason, reason);
+	queue_work(system_unbound_wq, &ct3_log_dump_w);
+}
+EXPORT_SYMBOL_GPL(ct3_log_dump);
+
+static int ct3_log_show(struct seq_file *m, void *data)
+{
+	struct ct3_log_entry *entries;
+	char line[96];
+	size_t n, i;
+
+	entries = ct3_log_collect(&n);
+	if (!entries)
+		return -ENOMEM;
+
+	for (i = 0; i < n; i++) {
+		ct3_log_format(&entries[i], line, sizeof(line));
+		seq_printf(m, "%s\n", line);
+	}
+
+	kvfree(entries);
+
+	return 0;
+}
+
+static int ct3_log_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ct3_log_show, NULL);
+}
+
+/* writing anything clears the log */
+static ssize_t ct3_log_write(struct file *file, const char __user *buf, size_t count,
+			     loff_t *ppos)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct ct3_log_cpu *log = per_cpu_ptr(&ct3_log_cpus, cpu);
+
+		memset(log->entries, 0, sizeof(log->entries));
+	}
+
+	return count;
+}
+
+static const struct file_operations ct3_log_fops = {
+	.owner = THIS_MODULE,
+	.open = ct3_log_open,
+	.read = seq_read,
+	.write = ct3_log_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static irqreturn_t ct3_te_irq_handler(int irq, void *data)
+{
+	struct ct3_te *te = data;
+
+	/* the irq is only enabled while waiting, a pulse nobody waits for is stray */
+	if (!wq_has_sleeper(&te->wq))
+		return IRQ_NONE;
+
+	WRITE_ONCE(te->timestamp, ktime_get());
+	WRITE_ONCE(te->count, te->count + 1);
+	wake_up_all(&te->wq);
+
+	return IRQ_HANDLED;
+}
+
+/**
+ * ct3_te_init - set up the TE interrupt
+ * @dev: panel device
+ * @te: TE state to initialize
+ *
+ * Uses the optional "te-gpios" property of the panel, which must be a line of
+ * its own. The TE input of the DSI host isn't shared, since decon requests its
+ * TE interrupt exclusively. The interrupt is only enabled while ct3_te_wait()
+ * waits for a pulse. Without a TE gpio ct3_wait_one_vblank() falls back to the
+ * CRTC vblank or to sleeping for one TE period.
+ */
+void ct3_te_init(struct device *dev, struct ct3_te *te)
+{
+	struct gpio_desc *gpio;
+	int ret;
+
+	te->irq = -ENOENT;
+	init_waitqueue_head(&te->wq);
+
+	gpio = devm_gpiod_get_optional(dev, "te", GPIOD_IN);
+	if (IS_ERR_OR_NULL(gpio))
+		return;
+
+	ret = gpiod_to_irq(gpio);
+	if (ret < 0) {
+		dev_warn(dev, "failed to get TE irq (%d)\n", ret);
+		return;
+	}
+
+	te->irq = ret;
+	ret = devm_request_irq(dev, te->irq, ct3_te_irq_handler,
+			       IRQF_TRIGGER_RISING | IRQF_NO_AUTOEN, dev_name(dev), te);
+	if (ret) {
+		dev_warn(dev, "failed to request TE irq (%d), wait on vblank instead\n", ret);
+		te->irq = -ENOENT;
+	}
+}
+EXPORT_SYMBOL_GPL(ct3_te_init);
+
+/**
+ * ct3_te_wait - wait for the next TE pulse
+ * @te: TE state
+ * @timeout_us: maximum time to wait
+ *
+ * May be called from several threads at once.
+ *
+ * Return: 0 once a TE pulse arrived, -ENODEV without a TE interrupt or
+ * -ETIMEDOUT if no pulse arrived in time
+ */
+int ct3_te_wait(struct ct3_te *te, u32 timeout_us)
+{
+	u32 count;
+	long ret;
+
+	if (te->irq < 0)
+		return -ENODEV;
+
+	enable_irq(te->irq);
+	count = READ_ONCE(te->count);
+	ret = wait_event_timeout(te->wq, READ_ONCE(te->count) != count,
+				 usecs_to_jiffies(timeout_us));
+	disable_irq_nosync(te->irq);
+
+	return ret ? 0 : -ETIMEDOUT;
+}
+EXPORT_SYMBOL_GPL(ct3_te_wait);
+
+/**
+ * ct3_wait_one_vblank - wait until the panel has started a new frame
+ * @ctx: gs_panel struct
+ * @te: TE state of the panel
+ *
+ * Prefers the panel TE interrupt, which works without a CRTC vblank reference,
+ * and then the CRTC vblank. As a last resort sleeps for one period of the
+ * current TE rate instead of a fixed 120Hz frame.
+ */
+void ct3_wait_one_vblank(struct gs_panel *ctx, struct ct3_te *te)
+{
+	const u32 te_hz = ctx->hw_status.te.rate_hz ?: 60;
+	const u32 period_us = GS_VREFRESH_TO_PERIOD_USEC(te_hz);
+	struct drm_crtc *crtc = NULL;
+	int ret;
+
+	/* allow for one missed pulse, e.g. while TE changes rate */
+	ret = ct3_te_wait(te, 2 * period_us);
+	if (ret == -ETIMEDOUT) {
+		ct3_log(ctx, CT3_LOG_TE_TIMEOUT, te_hz, 2 * period_us);
+		ct3_log_dump("TE timeout");
+	}
+	if (ret != -ENODEV)
+		return;
+
+	if (ctx->gs_connector->base.state)
+		crtc = ctx->gs_connector->base.state->crtc;
+
+	if (crtc && !drm_crtc_vblank_get(crtc)) {
+		drm_crtc_wait_one_vblank(crtc);
+		drm_crtc_vblank_put(crtc);
+		return;
+	}
+
+	usleep_range(period_us, period_us + 150);
+}
+EXPORT_SYMBOL_GPL(ct3_wait_one_vblank);
+
+/* TE needs a few frames to settle at a new rate before the phase means anything */
+#define CT3_TE_SYNC_SETTLE_MS 200
+/* panels drift apart by a few us per second, so the phase is checked once a second */
+#define CT3_TE_SYNC_INTERVAL_MS 1000
+/* phase errors below this aren't worth a TE reprogram */
+#define CT3_TE_SYNC_TOLERANCE_US 100
+
+static DEFINE_MUTEX(ct3_te_sync_lock);
+static struct ct3_te_sync *ct3_te_sync_panels[CT3_TE_SYNC_ROLE_MAX];
+/* follower TE delay behind the leader TE, 0 for half a TE period */
+static u32 ct3_te_sync_offset_us;
+static u32 ct3_te_sync_te_hz;
+static u32 ct3_te_sync_phase_us;
+static u32 ct3_te_sync_moves;
+
+static void ct3_te_sync_work_fn(struct work_struct *work);
+static DECLARE_DELAYED_WORK(ct3_te_sync_work, ct3_te_sync_work_fn);
+
+/* TE rate of a panel scanning out in a normal mode, 0 otherwise */
+static u32 ct3_te_sync_rate(struct gs_panel *ctx)
+{
+	u32 te_hz = 0;
+
+	mutex_lock(&ctx->mode_lock);
+	if (gs_is_panel_active(ctx) && ctx->current_mode &&
+	    !ctx->current_mode->gs_mode.is_lp_mode)
+		te_hz = gs_drm_mode_te_freq(&ctx->current_mode->mode);
+	mutex_unlock(&ctx->mode_lock);
+
+	return te_hz;
+}
+
+/*
+ * time of the next TE pulse of a panel. Without a TE interrupt the vblank of the
+ * panel's CRTC is used, it follows TE for command mode panels.
+ */
+static int ct3_te_sync_wait(struct ct3_te_sync *sync, u32 timeout_us, ktime_t *ts)
+{
+	struct drm_connector *conn = &sync->ctx->gs_connector->base;
+	struct drm_crtc *crtc = NULL;
+	u64 count;
+	long ret;
+
+	if (sync->te->irq >= 0) {
+		ret = ct3_te_wait(sync->te, timeout_us);
+		if (!ret)
+			*ts = READ_ONCE(sync->te->timestamp);
+		return ret;
+	}
+
+	drm_modeset_lock(&conn->dev->mode_config.connection_mutex, NULL);
+	if (conn->state)
+		crtc = conn->state->crtc;
+	drm_modeset_unlock(&conn->dev->mode_config.connection_mutex);
+	if (!crtc)
+		return -ENODEV;
+
+	ret = drm_crtc_vblank_get(crtc);
+	if (ret)
+		return ret;
+
+	count = drm_crtc_vblank_count(crtc);
+	ret = wait_event_timeout(*drm_crtc_vblank_waitqueue(crtc),
+				 drm_crtc_vblank_count_and_time(crtc, ts) != count,
+				 usecs_to_jiffies(timeout_us));
+	drm_crtc_vblank_put(crtc);
+
+	return ret ? 0 : -ETIMEDOUT;
+}
+
+/* time from the leader TE to the next follower TE */
+static int ct3_te_sync_measure(struct ct3_te_sync *leader, struct ct3_te_sync *follower,
+			       u32 period_us, u32 *phase_us)
+{
+	ktime_t leader_ts, follower_ts;
+	s64 delta_us;
+	int ret;
+
+	ret = ct3_te_sync_wait(leader, 2 * period_us, &leader_ts);
+	if (ret)
+		return ret;
+
+	ret = ct3_te_sync_wait(follower, 2 * period_us, &follower_ts);
+	if (ret)
+		return ret;
+
+	delta_us = ktime_us_delta(follower_ts, leader_ts);
+	if (delta_us < 0)
+		return -EAGAIN;
+	div_u64_rem(delta_us, period_us, phase_us);
+
+	return 0;
+}
+
+/* follower advance which puts its TE @offset_us behind the leader TE */
+static u32 ct3_te_sync_target(u32 phase_us, u32 advance_us, u32 offset_us, u32 period_us,
+			      u32 max_advance_us)
+{
+	u32 target = (phase_us + advance_us + period_us - offset_us) % period_us;
+
+	/* out of reach, stay at whichever end of the range is closer */
+	if (target > max_advance_us)
+		target = target - max_advance_us < period_us - target ? max_advance_us : 0;
+
+	return target;
+}
+
+static void ct3_te_sync_set(struct ct3_te_sync *sync, bool paired, u32 advance_us)
+{
+	if (sync->paired == paired && sync->advance_us == advance_us)
+		return;
+
+	WRITE_ONCE(sync->advance_us, advance_us);
+	WRITE_ONCE(sync->paired, paired);
+	if (sync->apply)
+		sync->apply(sync->ctx);
+}
+
+static void ct3_te_sync_work_fn(struct work_struct *work)
+{
+	struct ct3_te_sync *leader, *follower;
+	u32 te_hz = 0, period_us, offset_us, phase_us = 0, advance_us;
+	int ret;
+
+	mutex_lock(&ct3_te_sync_lock);
+	leader = ct3_te_sync_panels[CT3_TE_SYNC_LEADER];
+	follower = ct3_te_sync_panels[CT3_TE_SYNC_FOLLOWER];
+	if (!leader || !follower) {
+		/* a panel on its own runs free */
+		if (leader)
+			ct3_te_sync_set(leader, false, 0);
+		if (follower)
+			ct3_te_sync_set(follower, false, 0);
+		goto unlock;
+	}
+
+	te_hz = ct3_te_sync_rate(leader->ctx);
+	if (!te_hz || ct3_te_sync_rate(follower->ctx) != te_hz) {
+		/* free running again, the follower goes back to its default TE */
+		te_hz = 0;
+		ct3_te_sync_set(leader, false, 0);
+		ct3_te_sync_set(follower, false, 0);
+		goto unlock;
+	}
+
+	period_us = USEC_PER_SEC / te_hz;
+	ret = ct3_te_sync_measure(leader, follower, period_us, &phase_us);
+	if (ret) {
+		dev_dbg(follower->ctx->dev, "%s: failed to measure TE phase (%d)\n", __func__, ret);
+		goto requeue;
+	}
+
+	offset_us = (ct3_te_sync_offset_us ?: period_us / 2) % period_us;
+	advance_us = ct3_te_sync_target(phase_us, follower->advance_us, offset_us, period_us,
+					min(follower->max_advance_us, period_us));
+	ct3_te_sync_te_hz = te_hz;
+	ct3_te_sync_phase_us = phase_us;
+
+	ct3_te_sync_set(leader, true, 0);
+	if (abs((int)advance_us - (int)follower->advance_us) >= CT3_TE_SYNC_TOLERANCE_US ||
+	    !follower->paired) {
+		ct3_log(follower->ctx, CT3_LOG_TE_SYNC, phase_us, advance_us);
+		ct3_te_sync_moves++;
+		ct3_te_sync_set(follower, true, advance_us);
+	}
+
+requeue:
+	queue_delayed_work(system_unbound_wq, &ct3_te_sync_work,
+			   msecs_to_jiffies(CT3_TE_SYNC_INTERVAL_MS));
+unlock:
+	if (!te_hz)
+		ct3_te_sync_te_hz = 0;
+	mutex_unlock(&ct3_te_sync_lock);
+}
+
+/**
+ * ct3_te_sync_update - re-evaluate the TE phase lock after a panel state change
+ * @sync: TE phase lock state of the panel
+ *
+ * Called after enable, disable and mode changes, may be called with the panel
+ * mode_lock held. The phase is checked once the new TE rate has settled.
+ */
+void ct3_te_sync_update(const struct ct3_te_sync *sync)
+{
+	if (!sync->ctx)
+		return;
+
+	mod_delayed_work(system_unbound_wq, &ct3_te_sync_work,
+			 msecs_to_jiffies(CT3_TE_SYNC_SETTLE_MS));
+}
+EXPORT_SYMBOL_GPL(ct3_te_sync_update);
+
+/**
+ * ct3_te_sync_advance_lines - follower TE advance in lines of a mode
+ * @sync: TE phase lock state of the panel
+ * @mode: mode the TE is programmed for
+ *
+ * Return: number of lines before the end of the frame the TE should fire at,
+ * 0 to keep the default TE position
+ */
+u32 ct3_te_sync_advance_lines(const struct ct3_te_sync *sync,
+			      const struct drm_display_mode *mode)
+{
+	const u32 advance_us = READ_ONCE(sync->advance_us);
+	const u32 te_hz = gs_drm_mode_te_freq(mode);
+
+	if (!advance_us || !te_hz || sync->role != CT3_TE_SYNC_FOLLOWER)
+		return 0;
+
+	return min_t(u32, DIV_ROUND_CLOSEST_ULL((u64)advance_us * mode->vtotal * te_hz,
+						USEC_PER_SEC), mode->vtotal - 1);
+}
+EXPORT_SYMBOL_GPL(ct3_te_sync_advance_lines);
+
+static void ct3_te_sync_unregister(void *data)
+{
+	struct ct3_te_sync *sync = data;
+
+	mutex_lock(&ct3_te_sync_lock);
+	if (ct3_te_sync_panels[sync->role] == sync)
+		ct3_te_sync_panels[sync->role] = NULL;
+	mutex_unlock(&ct3_te_sync_lock);
+
+	/* the other panel returns to free running on the next run */
+	mod_delayed_work(system_unbound_wq, &ct3_te_sync_work, 0);
+	flush_delayed_work(&ct3_te_sync_work);
+	sync->ctx = NULL;
+}
+
+/**
+ * ct3_te_sync_register - take part in dual display TE phase lock
+ * @dev: panel device
+ * @sync: TE phase lock state, with @ctx, @te, @role and @apply set
+ *
+ * The offset of the follower TE behind the leader TE comes from the follower's
+ * "google,te-phase-offset-us" property, half a TE period by default, and can be
+ * changed through debugfs ct3/te_sync_offset_us. Panels without a TE interrupt
+ * are measured through the vblank timestamps of their CRTC instead.
+ *
+ * Return: 0 on success, negative error code otherwise
+ */
+int ct3_te_sync_register(struct device *dev, struct ct3_te_sync *sync)
+{
+	struct gs_panel *ctx = sync->ctx;
+	int ret = 0;
+
+	sync->ctx = NULL;
+	if (!ctx || !sync->te || sync->role >= CT3_TE_SYNC_ROLE_MAX)
+		return -EINVAL;
+
+	if (!sync->max_advance_us)
+		sync->max_advance_us = CT3_TE_SYNC_MAX_ADVANCE_US;
+	of_property_read_u32(dev->of_node, "google,te-phase-max-advance-us",
+			     &sync->max_advance_us);
+
+	mutex_lock(&ct3_te_sync_lock);
+	if (ct3_te_sync_panels[sync->role]) {
+		ret = -EBUSY;
+	} else {
+		sync->ctx = ctx;
+		sync->advance_us = 0;
+		sync->paired = false;
+		ct3_te_sync_panels[sync->role] = sync;
+		if (sync->role == CT3_TE_SYNC_FOLLOWER)
+			of_property_read_u32(dev->of_node, "google,te-phase-offset-us",
+					     &ct3_te_sync_offset_us);
+	}
+	mutex_unlock(&ct3_te_sync_lock);
+	if (ret)
+		return ret;
+
+	return devm_add_action_or_reset(dev, ct3_te_sync_unregister, sync);
+}
+EXPORT_SYMBOL_GPL(ct3_te_sync_register);
+
+static int ct3_te_sync_show(struct seq_file *m, void *data)
+{
+	const struct ct3_te_sync *follower;
+
+	mutex_lock(&ct3_te_sync_lock);
+	follower = ct3_te_sync_panels[CT3_TE_SYNC_FOLLOWER];
+	seq_printf(m, "leader: %s\n", ct3_te_sync_panels[CT3_TE_SYNC_LEADER] ?
+		   dev_name(ct3_te_sync_panels[CT3_TE_SYNC_LEADER]->ctx->dev) : "none");
+	seq_printf(m, "follower: %s\n", follower ? dev_name(follower->ctx->dev) : "none");
+	seq_printf(m, "paired: %d te_hz: %u\n", follower ? follower->paired : 0,
+		   ct3_te_sync_te_hz);
+	seq_printf(m, "phase_us: %u advance_us: %u moves: %u\n", ct3_te_sync_phase_us,
+		   follower ? follower->advance_us : 0, ct3_te_sync_moves);
+	mutex_unlock(&ct3_te_sync_lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ct3_te_sync);
+
+static const struct ct3_ffc_payload *ct3_ffc_find_payload(const struct ct3_ffc *ffc,
+							  u32 hs_clk_mbps)
+{
+	unsigned int i;
+
+	for (i = 0; i < ffc->num_payloads; i++) {
+		if (ffc->payloads[i].hs_clk_mbps == hs_clk_mbps)
+			return &ffc->payloads[i];
+	}
+
+	return NULL;
+}
+
+/**
+ * ct3_ffc_init - load the DSI rates a panel may hop between
+ * @dev: panel device
+ * @ffc: hopping state to initialize
+ * @payloads: prebuilt FFC settings
+ * @num_payloads: number of entries in @payloads
+ * @page: CMD2 page holding the 0xC3 FFC register
+ *
+ * The candidate rates come from the "google,dsi-hs-clk-mbps" property. Rates
+ * without a prebuilt payload are dropped. By default every rate with a
+ * payload is allowed.
+ */
+void ct3_ffc_init(struct device *dev, struct ct3_ffc *ffc,
+		  const struct ct3_ffc_payload *payloads,
+		  unsigned int num_payloads, u8 page)
+{
+	u32 rates[CT3_FFC_MAX_RATES];
+	int i, n;
+
+	ffc->payloads = payloads;
+	ffc->num_payloads = num_payloads;
+	ffc->page = page;
+	ffc->num_rates = 0;
+
+	n = of_property_read_variable_u32_array(dev->of_node, "google,dsi-hs-clk-mbps",
+						rates, 1, CT3_FFC_MAX_RATES);
+	if (n <= 0) {
+		for (i = 0; i < num_payloads && i < CT3_FFC_MAX_RATES; i++)
+			ffc->rates[ffc->num_rates++] = payloads[i].hs_clk_mbps;
+		return;
+	}
+
+	for (i = 0; i < n; i++) {
+		if (!ct3_ffc_find_payload(ffc, rates[i])) {
+			dev_warn(dev, "no FFC setting for %u mbps, skip\n", rates[i]);
+			continue;
+		}
+		ffc->rates[ffc->num_rates++] = rates[i];
+	}
+}
+EXPORT_SYMBOL_GPL(ct3_ffc_init);
+
+bool ct3_ffc_rate_allowed(const struct ct3_ffc *ffc, u32 hs_clk_mbps)
+{
+	unsigned int i;
+
+	for (i = 0; i < ffc->num_rates; i++) {
+		if (ffc->rates[i] == hs_clk_mbps)
+			return true;
+	}
+
+	return false;
+}
+EXPORT_SYMBOL_GPL(ct3_ffc_rate_allowed);
+
+/**
+ * ct3_ffc_pre_update - disable FFC ahead of a DSI rate change
+ * @ctx: gs_panel struct
+ * @ffc: hopping state
+ *
+ * Has to go out at the old rate, so it is flushed on its own.
+ */
+void ct3_ffc_pre_update(struct gs_panel *ctx, const struct ct3_ffc *ffc)
+{
+	struct device *dev = ctx->dev;
+
+	GS_DCS_BUF_ADD_CMD(dev, 0xF0, 0x55, 0xAA, 0x52, 0x08, ffc->page);
+	GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0xC3, 0x00);
+}
+EXPORT_SYMBOL_GPL(ct3_ffc_pre_update);
+
+/**
+ * ct3_ffc_update - program FFC for the new DSI rate and enable it again
+ * @ctx: gs_panel struct
+ * @ffc: hopping state
+ * @hs_clk_mbps: new DSI rate
+ *
+ * The prebuilt setting and FFC enable are sent in one transfer, which the
+ * panel latches with the next frame.
+ */
+void ct3_ffc_update(struct gs_panel *ctx, const struct ct3_ffc *ffc, u32 hs_clk_mbps)
+{
+	struct device *dev = ctx->dev;
+	const struct ct3_ffc_payload *payload = NULL;
+
+	dev_dbg(dev, "%s: hs_clk_mbps: current=%d, target=%d\n",
+		__func__, ctx->dsi_hs_clk_mbps, hs_clk_mbps);
+
+	if (!ct3_ffc_rate_allowed(ffc, hs_clk_mbps)) {
+		dev_warn(dev, "invalid hs_clk_mbps=%d for FFC\n", hs_clk_mbps);
+	} else if (ctx->dsi_hs_clk_mbps != hs_clk_mbps) {
+		dev_dbg(dev, "%s: updating for hs_clk_mbps=%d\n", __func__, hs_clk_mbps);
+		ct3_log(ctx, CT3_LOG_FFC, hs_clk_mbps, ctx->dsi_hs_clk_mbps);
+		ctx->dsi_hs_clk_mbps = hs_clk_mbps;
+		payload = ct3_ffc_find_payload(ffc, hs_clk_mbps);
+	}
+
+	GS_DCS_BUF_ADD_CMD(dev, 0xF0, 0x55, 0xAA, 0x52, 0x08, ffc->page);
+	if (payload)
+		gs_dsi_dcs_write_buffer(to_mipi_dsi_device(dev), payload->cmd, payload->len,
+					GS_DSI_MSG_QUEUE);
+	GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0xC3, 0xDD);
+}
+EXPORT_SYMBOL_GPL(ct3_ffc_update);
+
+/**
+ * ct3_input_connect - input handler connect callback for the ct3 panel drivers
+ * @handler: handler with the panel in &input_handler.private
+ * @dev: matching input device
+ * @id: matching id table entry
+ *
+ * Return: 0 on success, negative error code otherwise
+ */
+int ct3_input_connect(struct input_handler *handler, struct input_dev *dev,
+		      const struct input_device_id *id)
+{
+	struct input_handle *handle;
+	int ret;
+
+	handle = kzalloc(sizeof(*handle), GFP_KERNEL);
+	if (!handle)
+		return -ENOMEM;
+
+	handle->dev = dev;
+	handle->handler = handler;
+	handle->name = handler->name;
+	handle->private = handler->private;
+
+	ret = input_register_handle(handle);
+	if (ret)
+		goto err_free;
+
+	ret = input_open_device(handle);
+	if (ret)
+		goto err_unregister;
+
+	return 0;
+
+err_unregister:
+	input_unregister_handle(handle);
+err_free:
+	kfree(handle);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ct3_input_connect);
+
+void ct3_input_disconnect(struct input_handle *handle)
+{
+	input_close_device(handle);
+	input_unregister_handle(handle);
+	kfree(handle);
+}
+EXPORT_SYMBOL_GPL(ct3_input_disconnect);
+
+static void ct3_prewarm_work(struct work_struct *work)
+{
+	struct ct3_prewarm *pw = container_of(work, struct ct3_prewarm, work);
+	struct gs_panel *ctx = pw->ctx;
+
+	mutex_lock(&pw->lock);
+	if (pw->prepared || pw->state != CT3_PREWARM_NONE)
+		goto out;
+
+	PANEL_ATRACE_BEGIN(__func__);
+	if (!gs_panel_prepare(&ctx->base)) {
+		gs_panel_reset_helper(ctx);
+		pw->prepared = true;
+		pw->state = CT3_PREWARM_READY;
+		schedule_delayed_work(&pw->timeout_work, msecs_to_jiffies(pw->timeout_ms));
+		dev_dbg(ctx->dev, "%s: panel ready, waiting for display on\n", __func__);
+	}
+	PANEL_ATRACE_END(__func__);
+out:
+	mutex_unlock(&pw->lock);
+}
+
+/* powers a pre-warmed panel off again, called with lock held */
+static void ct3_prewarm_release(struct ct3_prewarm *pw)
+{
+	if (pw->state != CT3_PREWARM_READY)
+		return;
+
+	dev_dbg(pw->ctx->dev, "%s: pre-warm not claimed, power off\n", __func__);
+	gs_panel_unprepare(&pw->ctx->base);
+	pw->prepared = false;
+	pw->state = CT3_PREWARM_NONE;
+}
+
+static void ct3_prewarm_timeout_work(struct work_struct *work)
+{
+	struct ct3_prewarm *pw = container_of(to_delayed_work(work), struct ct3_prewarm,
+					      timeout_work);
+
+	mutex_lock(&pw->lock);
+	ct3_prewarm_release(pw);
+	mutex_unlock(&pw->lock);
+}
+
+static void ct3_prewarm_event(struct input_handle *handle, unsigned int type,
+			      unsigned int code, int value)
+{
+	struct ct3_prewarm *pw = handle->private;
+
+	if (type != EV_SW || code != SW_LID)
+		return;
+
+	/* lid switch is released as soon as the hinge starts opening */
+	if (!value)
+		queue_work(system_highpri_wq, &pw->work);
+	else
+		mod_delayed_work(system_wq, &pw->timeout_work, 0);
+}
+
+/* only the hinge hall sensor, not any other device that happens to report SW_LID */
+static bool ct3_prewarm_match(struct input_handler *handler, struct input_dev *dev)
+{
+	const struct ct3_prewarm *pw = handler->private;
+
+	return dev->dev.parent && dev->dev.parent->of_node == pw->sensor;
+}
+
+static const struct input_device_id ct3_prewarm_ids[] = {
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT | INPUT_DEVICE_ID_MATCH_SWBIT,
+		.evbit = { BIT_MASK(EV_SW) },
+		.swbit = { [BIT_WORD(SW_LID)] = BIT_MASK(SW_LID) },
+	},
+	{ },
+};
+
+/**
+ * ct3_prewarm_init - set up the pre-warm state
+ * @ctx: panel
+ * @pw: pre-warm state
+ *
+ * Must be called at probe, before prepare can run. Listening to the hall sensor
+ * only starts with ct3_prewarm_register().
+ */
+void ct3_prewarm_init(struct gs_panel *ctx, struct ct3_prewarm *pw)
+{
+	pw->ctx = ctx;
+	pw->state = CT3_PREWARM_NONE;
+	pw->timeout_ms = CT3_PREWARM_TIMEOUT_MS;
+	mutex_init(&pw->lock);
+	INIT_WORK(&pw->work, ct3_prewarm_work);
+	INIT_DELAYED_WORK(&pw->timeout_work, ct3_prewarm_timeout_work);
+}
+EXPORT_SYMBOL_GPL(ct3_prewarm_init);
+
+/**
+ * ct3_prewarm_register - start listening to the hall sensor
+ * @pw: pre-warm state
+ *
+ * When "google,hall-sensor" points at the hinge hall sensor, opening the hinge
+ * powers the panel on and takes it out of reset before the display switch is
+ * committed, hiding the regulator and reset timing behind the hinge motion. The
+ * init sequence can't be sent ahead of time since the DSI link only comes up
+ * with the commit. The panel powers off again if prepare doesn't claim it
+ * within "google,hall-prewarm-timeout-ms".
+ */
+void ct3_prewarm_register(struct ct3_prewarm *pw)
+{
+	struct device *dev = pw->ctx->dev;
+	struct input_handler *handler = &pw->handler;
+
+	pw->sensor = of_parse_phandle(dev->of_node, "google,hall-sensor", 0);
+	if (!pw->sensor)
+		return;
+
+	of_property_read_u32(dev->of_node, "google,hall-prewarm-timeout-ms", &pw->timeout_ms);
+
+	handler->name = "ct3_prewarm";
+	handler->private = pw;
+	handler->event = ct3_prewarm_event;
+	handler->match = ct3_prewarm_match;
+	handler->connect = ct3_input_connect;
+	handler->disconnect = ct3_input_disconnect;
+	handler->id_table = ct3_prewarm_ids;
+
+	if (input_register_handler(handler)) {
+		dev_warn(dev, "failed to register hall sensor handler\n");
+		of_node_put(pw->sensor);
+		pw->sensor = NULL;
+		return;
+	}
+	pw->registered = true;
+}
+EXPORT_SYMBOL_GPL(ct3_prewarm_register);
+
+/**
+ * ct3_prewarm_remove - stop pre-warming and power off a panel that wasn't claimed
+ * @pw: pre-warm state
+ *
+ * Must be called from the panel remove callback before the panel is torn down.
+ */
+void ct3_prewarm_remove(struct ct3_prewarm *pw)
+{
+	if (pw->registered) {
+		input_unregister_handler(&pw->handler);
+		pw->registered = false;
+	}
+	cancel_work_sync(&pw->work);
+	cancel_delayed_work_sync(&pw->timeout_work);
+
+	mutex_lock(&pw->lock);
+	ct3_prewarm_release(pw);
+	mutex_unlock(&pw->lock);
+
+	of_node_put(pw->sensor);
+	pw->sensor = NULL;
+}
+EXPORT_SYMBOL_GPL(ct3_prewarm_remove);
+
+/**
+ * ct3_prewarm_prepare - prepare the panel, claiming it if it is pre-warmed
+ * @pw: pre-warm state
+ *
+ * Return: 0 on success, negative error code otherwise
+ */
+int ct3_prewarm_prepare(struct ct3_prewarm *pw)
+{
+	struct gs_panel *ctx = pw->ctx;
+	int ret = 0;
+
+	mutex_lock(&pw->lock);
+	if (pw->state == CT3_PREWARM_READY) {
+		/* timeout work checks the state under lock, no need to sync here */
+		cancel_delayed_work(&pw->timeout_work);
+		pw->state = CT3_PREWARM_CLAIMED;
+		dev_dbg(ctx->dev, "%s: claim pre-warmed panel\n", __func__);
+	} else {
+		ret = gs_panel_prepare(&ctx->base);
+	}
+	if (!ret)
+		pw->prepared = true;
+	mutex_unlock(&pw->lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ct3_prewarm_prepare);
+
+int ct3_prewarm_unprepare(struct ct3_prewarm *pw)
+{
+	int ret;
+
+	mutex_lock(&pw->lock);
+	pw->state = CT3_PREWARM_NONE;
+	ret = gs_panel_unprepare(&pw->ctx->base);
+	pw->prepared = false;
+	mutex_unlock(&pw->lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ct3_prewarm_unprepare);
+
+/**
+ * ct3_prewarm_reset - reset the panel at enable unless it was pre-warmed
+ * @pw: pre-warm state
+ */
+void ct3_prewarm_reset(struct ct3_prewarm *pw)
+{
+	mutex_lock(&pw->lock);
+	if (pw->state == CT3_PREWARM_CLAIMED)
+		dev_dbg(pw->ctx->dev, "%s: panel pre-warmed, skip reset\n", __func__);
+	else
+		gs_panel_reset_helper(pw->ctx);
+	pw->state = CT3_PREWARM_NONE;
+	mutex_unlock(&pw->lock);
+}
+EXPORT_SYMBOL_GPL(ct3_prewarm_reset);
+
+static void ct3_bl_snapshot_work(struct work_struct *work)
+{
+	struct ct3_bl_snapshot *snap = container_of(work, struct ct3_bl_snapshot, work);
+	struct gs_panel *ctx = snap->ctx;
+
+	if (READ_ONCE(snap->removed))
+		return;
+
+	WRITE_ONCE(snap->pushed, atomic_read(&snap->brightness));
+	if (ctx->thermal && !IS_ERR_OR_NULL(ctx->thermal->tz))
+		thermal_zone_device_update(ctx->thermal->tz, THERMAL_EVENT_UNSPECIFIED);
+}
+
+static void ct3_bl_snapshot_cancel(void *data)
+{
+	struct ct3_bl_snapshot *snap = data;
+
+	cancel_work_sync(&snap->work);
+}
+
+int ct3_bl_snapshot_init(struct device *dev, struct ct3_bl_snapshot *snap,
+			 struct gs_panel *ctx)
+{
+	snap->ctx = ctx;
+	atomic_set(&snap->brightness, -1);
+	snap->pushed = -1;
+	INIT_WORK(&snap->work, ct3_bl_snapshot_work);
+
+	/* for probe failures, removal goes through ct3_bl_snapshot_remove() */
+	return devm_add_action_or_reset(dev, ct3_bl_snapshot_cancel, snap);
+}
+EXPORT_SYMBOL_GPL(ct3_bl_snapshot_init);
+
+/**
+ * ct3_bl_snapshot_remove - stop pushing brightness to the thermal zone
+ * @snap: brightness snapshot
+ *
+ * Has to be called from the driver's remove before gs_dsi_panel_common_remove()
+ * unregisters the thermal zone. Brightness published by the teardown after
+ * this isn't pushed anymore.
+ */
+void ct3_bl_snapshot_remove(struct ct3_bl_snapshot *snap)
+{
+	WRITE_ONCE(snap->removed, true);
+	cancel_work_sync(&snap->work);
+}
+EXPORT_SYMBOL_GPL(ct3_bl_snapshot_remove);
+
+/**
+ * ct3_bl_get_brightness - thermal zone callback reading the brightness snapshot
+ * @snap: brightness snapshot
+ * @temp: returns the brightness
+ *
+ * Falls back to reading the backlight device under bl_state_lock until the driver
+ * has published a value.
+ *
+ * Return: 0 on success, -EINVAL if there's no backlight device
+ */
+int ct3_bl_get_brightness(struct ct3_bl_snapshot *snap, int *temp)
+{
+	struct gs_panel *ctx = snap->ctx;
+	int brightness = atomic_read(&snap->brightness);
+
+	if (brightness >= 0) {
+		*temp = brightness;
+		return 0;
+	}
+
+	if (!ctx->bl)
+		return -EINVAL;
+
+	mutex_lock(&ctx->bl_state_lock);
+	*temp = (ctx->bl->props.state & BL_STATE_STANDBY) ? 0 : ctx->bl->props.brightness;
+	mutex_unlock(&ctx->bl_state_lock);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(ct3_bl_get_brightness);
+
+static int ct3_bl_thermal_get_temp(struct thermal_zone_device *tzd, int *temp)
+{
+	struct ct3_bl_snapshot *snap;
+
+	if (tzd == NULL)
+		return -EINVAL;
+
+	snap = tzd->devdata;
+	if (!snap)
+		return -EINVAL;
+
+	return ct3_bl_get_brightness(snap, temp);
+}
+
+static struct thermal_zone_device_ops ct3_bl_tzd_ops = {
+	.get_temp = ct3_bl_thermal_get_temp,
+};
+
+/**
+ * ct3_bl_thermal_init - register a thermal zone reporting the panel brightness
+ * @dev: panel device
+ * @snap: brightness snapshot read by the zone, already initialized
+ * @type: thermal zone type
+ *
+ * The zone is stored in ctx->thermal->tz. Failing to register it isn't fatal for
+ * the panel, so only allocation failures are returned.
+ *
+ * Return: 0 on success, -ENOMEM if ctx->thermal can't be allocated
+ */
+int ct3_bl_thermal_init(struct device *dev, struct ct3_bl_snapshot *snap, const char *type)
+{
+	struct gs_panel *ctx = snap->ctx;
+	int ret;
+
+	ctx->thermal = devm_kzalloc(dev, sizeof(*ctx->thermal), GFP_KERNEL);
+	if (!ctx->thermal)
+		return -ENOMEM;
+
+	ctx->thermal->tz = thermal_zone_device_register(type, 0, 0, snap, &ct3_bl_tzd_ops,
+							NULL, 0, 0);
+	if (IS_ERR(ctx->thermal->tz)) {
+		dev_err(dev, "failed to register %s thermal zone: %ld\n", type,
+			PTR_ERR(ctx->thermal->tz));
+		return 0;
+	}
+
+	ret = thermal_zone_device_enable(ctx->thermal->tz);
+	if (ret) {
+		dev_err(dev, "failed to enable %s thermal zone ret=%d\n", type, ret);
+		thermal_zone_device_unregister(ctx->thermal->tz);
+		ctx->thermal->tz = NULL;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(ct3_bl_thermal_init);
+
+/**
+ * ct3_dimming_update - recompute the dimming frame count for a refresh rate
+ * @dim: dimming state
+ * @vrefresh: refresh rate brightness ramps will run at
+ *
+ * Return: true if the frame count changed and needs to be sent to the DDIC
+ */
+bool ct3_dimming_update(struct ct3_dimming *dim, u32 vrefresh)
+{
+	u32 frames;
+
+	if (!vrefresh)
+		return false;
+
+	frames = clamp_t(u32, DIV_ROUND_UP(dim->duration_ms * vrefresh, MSEC_PER_SEC), 1, U8_MAX);
+	dim->vrefresh = vrefresh;
+	if (frames == dim->frames)
+		return false;
+
+	dim->frames = frames;
+
+	return true;
+}
+EXPORT_SYMBOL_GPL(ct3_dimming_update);
+
+/**
+ * ct3_dimming_start - note that a brightness ramp was started
+ * @dim: dimming state
+ *
+ * Return: time the ramp finishes
+ */
+ktime_t ct3_dimming_start(struct ct3_dimming *dim)
+{
+	const u32 vrefresh = dim->vrefresh ?: 60;
+	const u8 frames = dim->frames ?: U8_MAX;
+
+	dim->end = ktime_add_us(ktime_get(), div_u64((u64)frames * USEC_PER_SEC, vrefresh));
+
+	return dim->end;
+}
+EXPORT_SYMBOL_GPL(ct3_dimming_start);
+
+/**
+ * ct3_dimming_busy - check whether a brightness ramp may still be running
+ * @ctx: gs_panel struct
+ * @dim: dimming state, NULL if the driver doesn't track ramps
+ *
+ * Return: true while dimming is on and, if tracked, the last ramp hasn't finished
+ */
+bool ct3_dimming_busy(const struct gs_panel *ctx, const struct ct3_dimming *dim)
+{
+	if (!ctx->dimming_on)
+		return false;
+
+	return !dim || ktime_before(ktime_get(), dim->end);
+}
+EXPORT_SYMBOL_GPL(ct3_dimming_busy);
+
+/**
+ * ct3_is_auto_mode_allowed - check whether the panel may lower its refresh rate itself
+ * @ctx: gs_panel struct
+ * @dim: dimming state, NULL if the driver doesn't track ramps
+ *
+ * Return: true if panel idle is enabled, no brightness ramp is running and the idle
+ * delay has passed
+ */
+bool ct3_is_auto_mode_allowed(struct gs_panel *ctx, const struct ct3_dimming *dim)
+{
+	/* don't want to enable auto mode/early exit during dimming */
+	if (ct3_dimming_busy(ctx, dim))
+		return false;
+
+	if (ctx->idle_data.idle_delay_ms) {
+		const unsigned int delta_ms = gs_panel_get_idle_time_delta(ctx);
+
+		if (delta_ms < ctx->idle_data.idle_delay_ms)
+			return false;
+	}
+
+	return ctx->idle_data.panel_idle_enabled;
+}
+EXPORT_SYMBOL_GPL(ct3_is_auto_mode_allowed);
+
+/**
+ * ct3_get_min_idle_vrefresh - pick the refresh rate auto mode may drop to
+ * @ctx: gs_panel struct
+ * @pmode: target panel mode
+ * @dim: dimming state, NULL if the driver doesn't track ramps
+ * @floor_hz: lowest rate the driver wants to allow, 0 for no limit
+ *
+ * Rounds ctx->min_vrefresh up to one of the 1/10/30Hz idle rates the ct3 DDICs
+ * support, raised to @floor_hz.
+ *
+ * Return: idle refresh rate, 0 if auto mode shouldn't be used
+ */
+u32 ct3_get_min_idle_vrefresh(struct gs_panel *ctx, const struct gs_panel_mode *pmode,
+			      const struct ct3_dimming *dim, u32 floor_hz)
+{
+	const int vrefresh = drm_mode_vrefresh(&pmode->mode);
+	int min_idle_vrefresh = ctx->min_vrefresh;
+
+	if ((min_idle_vrefresh < 0) || !ct3_is_auto_mode_allowed(ctx, dim))
+		return 0;
+
+	if (min_idle_vrefresh <= 1)
+		min_idle_vrefresh = 1;
+	else if (min_idle_vrefresh <= 10)
+		min_idle_vrefresh = 10;
+	else if (min_idle_vrefresh <= 30)
+		min_idle_vrefresh = 30;
+	else
+		return 0;
+
+	if (floor_hz > min_idle_vrefresh)
+		min_idle_vrefresh = floor_hz;
+
+	if (min_idle_vrefresh >= vrefresh) {
+		dev_dbg(ctx->dev, "min idle vrefresh (%d) higher than target (%d)\n",
+				min_idle_vrefresh, vrefresh);
+		return 0;
+	}
+
+	dev_dbg(ctx->dev, "%s: min_idle_vrefresh %d\n", __func__, min_idle_vrefresh);
+
+	return min_idle_vrefresh;
+}
+EXPORT_SYMBOL_GPL(ct3_get_min_idle_vrefresh);
+
+/**
+ * ct3_set_self_refresh - set_self_refresh implementation of the ct3 panels
+ * @ctx: gs_panel struct
+ * @vrr: VRR state machine of the panel
+ * @enable: self refresh is active
+ *
+ * Return: true if the refresh mode changed
+ */
+bool ct3_set_self_refresh(struct gs_panel *ctx, const struct ct3_vrr *vrr, bool enable)
+{
+	const struct ct3_vrr_funcs *funcs = vrr->funcs;
+	const struct gs_panel_mode *pmode = ctx->current_mode;
+	u32 idle_vrefresh;
+
+	dev_dbg(ctx->dev, "%s: %d\n", __func__, enable);
+
+	if (unlikely(!pmode))
+		return false;
+
+	/* self refresh is not supported in lp mode since that always makes use of early exit */
+	if (pmode->gs_mode.is_lp_mode) {
+		/* set 1Hz while self refresh is active, otherwise clear it */
+		ctx->idle_data.panel_idle_vrefresh = enable ? 1 : 0;
+		notify_panel_mode_changed(ctx);
+		if (funcs->set_lp_self_refresh)
+			funcs->set_lp_self_refresh(ctx, enable);
+		return false;
+	}
+
+	idle_vrefresh = funcs->get_min_idle_vrefresh(ctx, pmode);
+
+	if (pmode->idle_mode != GIDLE_MODE_ON_SELF_REFRESH) {
+		/*
+		 * if idle mode is on inactivity, may need to update the target fps for auto mode,
+		 * or switch to manual mode if idle should be disabled (idle_vrefresh=0)
+		 */
+		if ((pmode->idle_mode == GIDLE_MODE_ON_INACTIVITY) &&
+			(funcs->get_auto_mode_vrefresh(ctx) != idle_vrefresh)) {
+			funcs->update_refresh_mode(ctx, pmode, idle_vrefresh);
+			return true;
+		}
+		return false;
+	}
+
+	if (!enable)
+		idle_vrefresh = 0;
+
+	/* if there's no change in idle state then skip cmds */
+	if (ctx->idle_data.panel_idle_vrefresh == idle_vrefresh)
+		return false;
+
+	PANEL_ATRACE_BEGIN(__func__);
+	funcs->update_refresh_mode(ctx, pmode, idle_vrefresh);
+
+	if (idle_vrefresh) {
+		const int vrefresh = drm_mode_vrefresh(&pmode->mode);
+
+		ct3_panel_idle_notification(ctx, 0, vrefresh, 120);
+	} else if (ctx->idle_data.panel_need_handle_idle_exit) {
+		/*
+		 * after exit idle mode with fixed TE at non-120hz, TE may still keep at 120hz.
+		 * If any layer that already be assigned to DPU that can't be handled at 120hz,
+		 * panel_need_handle_idle_exit will be set then we need to wait one vblank to
+		 * avoid underrun issue.
+		 */
+		dev_dbg(ctx->dev, "wait one vblank after exit idle\n");
+		ct3_wait_one_vblank(ctx, vrr->te);
+	}
+
+	PANEL_ATRACE_END(__func__);
+
+	return true;
+}
+EXPORT_SYMBOL_GPL(ct3_set_self_refresh);
+
+/**
+ * ct3_early_exit - get the panel out of idle for a frame arriving after a pause
+ * @ctx: gs_panel struct
+ * @vrr: VRR state machine of the panel
+ * @force_changeable_te: the panel uses changeable TE during early exit
+ *
+ * Triggers early exit by command if the TE is changeable and there's no switching
+ * delay, which boosts to 120Hz fast and shows 120Hz TE earlier. Otherwise turns
+ * off auto mode, so the panel doesn't lower its frequency too fast.
+ *
+ * Return: true if the panel stays in auto mode, false if it was switched to manual
+ */
+bool ct3_early_exit(struct gs_panel *ctx, const struct ct3_vrr *vrr, bool force_changeable_te)
+{
+	/* triggering early exit causes a switch to 120hz */
+	ctx->timestamps.last_mode_set_ts = ktime_get();
+
+	if (!ctx->idle_data.idle_delay_ms && force_changeable_te) {
+		dev_dbg(ctx->dev, "sending early exit out cmd\n");
+		vrr->funcs->send_early_exit(ctx);
+		return true;
+	}
+
+	vrr->funcs->update_refresh_mode(ctx, ctx->current_mode, 0);
+
+	return false;
+}
+EXPORT_SYMBOL_GPL(ct3_early_exit);
+
+/* records kept for readers of the event device, must be a power of two */
+#define CT3_EVENT_RING_SIZE 64
+/* readers are woken up at most once per batch period */
+#define CT3_EVENT_BATCH_MS 100
+
+/*
+ * Records are kept in a ring shared by all readers, each open file tracks the seq
+ * of the next record it reads. A reader that fell more than a ring behind skips to
+ * the oldest record still kept.
+ */
+static DEFINE_SPINLOCK(ct3_event_lock);
+static struct ct3_panel_event ct3_event_ring[CT3_EVENT_RING_SIZE];
+/* seq of the next record pushed */
+static u32 ct3_event_seq;
+static DECLARE_WAIT_QUEUE_HEAD(ct3_event_wq);
+static ktime_t ct3_event_last_wake;
+/* open files of the event device */
+static atomic_t ct3_event_readers = ATOMIC_INIT(0);
+
+static void ct3_event_wake_work(struct work_struct *work)
+{
+	WRITE_ONCE(ct3_event_last_wake, ktime_get());
+	wake_up_interruptible(&ct3_event_wq);
+}
+static DECLARE_DELAYED_WORK(ct3_event_wake, ct3_event_wake_work);
+
+static void ct3_event_push(struct ct3_panel_event *ev)
+{
+	const ktime_t now = ktime_get();
+	unsigned long flags;
+
+	spin_lock_irqsave(&ct3_event_lock, flags);
+	ev->seq = ct3_event_seq;
+	ct3_event_ring[ct3_event_seq % CT3_EVENT_RING_SIZE] = *ev;
+	WRITE_ONCE(ct3_event_seq, ct3_event_seq + 1);
+	spin_unlock_irqrestore(&ct3_event_lock, flags);
+
+	if (ktime_ms_delta(now, READ_ONCE(ct3_event_last_wake)) >= CT3_EVENT_BATCH_MS)
+		mod_delayed_work(system_wq, &ct3_event_wake, 0);
+	else
+		schedule_delayed_work(&ct3_event_wake, msecs_to_jiffies(CT3_EVENT_BATCH_MS));
+}
+
+/* per open file state of the event device */
+struct ct3_event_reader {
+	/* seq of the next record to read */
+	u32 seq;
+};
+
+static bool ct3_event_pending(const struct ct3_event_reader *reader)
+{
+	return READ_ONCE(ct3_event_seq) != reader->seq;
+}
+
+/* readers only see records pushed after they opened the device */
+static int ct3_event_open(struct inode *inode, struct file *file)
+{
+	struct ct3_event_reader *reader;
+
+	reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+	if (!reader)
+		return -ENOMEM;
+
+	reader->seq = READ_ONCE(ct3_event_seq);
+	file->private_data = reader;
+	atomic_inc(&ct3_event_readers);
+
+	return nonseekable_open(inode, file);
+}
+
+static int ct3_event_release(struct inode *inode, struct file *file)
+{
+	atomic_dec(&ct3_event_readers);
+	kfree(file->private_data);
+
+	return 0;
+}
+
+/* whole records only, as many as fit in @count */
+static ssize_t ct3_event_read(struct file *file, char __user *buf, size_t count, loff_t *ppos)
+{
+	struct ct3_event_reader *reader = file->private_data;
+	struct ct3_panel_event evs[8];
+	unsigned long flags;
+	ssize_t copied = 0;
+	int ret;
+
+	if (count < sizeof(evs[0]))
+		return -EINVAL;
+
+	if (!ct3_event_pending(reader)) {
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		ret = wait_event_interruptible(ct3_event_wq, ct3_event_pending(reader));
+		if (ret)
+			return ret;
+	}
+
+	while (count - copied >= sizeof(evs[0])) {
+		unsigned int n = min_t(size_t, ARRAY_SIZE(evs), (count - copied) / sizeof(evs[0]));
+		unsigned int i;
+
+		spin_lock_irqsave(&ct3_event_lock, flags);
+		/* overwritten records are lost, the reader sees the gap in seq */
+		if (ct3_event_seq - reader->seq > CT3_EVENT_RING_SIZE)
+			reader->seq = ct3_event_seq - CT3_EVENT_RING_SIZE;
+		n = min(n, ct3_event_seq - reader->seq);
+		for (i = 0; i < n; i++)
+			evs[i] = ct3_event_ring[(reader->seq + i) % CT3_EVENT_RING_SIZE];
+		reader->seq += n;
+		spin_unlock_irqrestore(&ct3_event_lock, flags);
+		if (!n)
+			break;
+
+		if (copy_to_user(buf + copied, evs, n * sizeof(evs[0])))
+			return copied ?: -EFAULT;
+		copied += n * sizeof(evs[0]);
+	}
+
+	return copied;
+}
+
+static __poll_t ct3_event_poll(struct file *file, poll_table *wait)
+{
+	poll_wait(file, &ct3_event_wq, wait);
+
+	return ct3_event_pending(file->private_data) ? EPOLLIN | EPOLLRDNORM : 0;
+}
+
+static const struct file_operations ct3_event_fops = {
+	.owner = THIS_MODULE,
+	.open = ct3_event_open,
+	.release = ct3_event_release,
+	.read = ct3_event_read,
+	.poll = ct3_event_poll,
+};
+
+static struct miscdevice ct3_event_dev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "ct3_panel_events",
+	.fops = &ct3_event_fops,
+};
+
+/**
+ * ct3_panel_idle_notification - tell userspace the panel entered idle
+ * @ctx: gs_panel struct
+ * @display_id: display index
+ * @vrefresh: refresh rate of the current mode
+ * @idle_te_vrefresh: TE rate while idle
+ *
+ * A record goes to /dev/ct3_panel_events, where readers get batches of records
+ * instead of a wakeup per idle entry. The PANEL_IDLE_ENTER uevent is only sent
+ * while nobody has the device open: HWC still relies on it when it doesn't read
+ * the device.
+ */
+void ct3_panel_idle_notification(struct gs_panel *ctx, u32 display_id, u32 vrefresh,
+				 u32 idle_te_vrefresh)
+{
+	struct ct3_panel_event ev = {
+		.timestamp_ns = ktime_get_ns(),
+		.display_id = display_id,
+		.vrefresh = vrefresh,
+		.idle_vrefresh = ctx->idle_data.panel_idle_vrefresh,
+		.te_vrefresh = idle_te_vrefresh,
+	};
+	char event_string[64];
+	char *envp[] = { event_string, NULL };
+	struct drm_device *dev = ctx->bridge.dev;
+
+	ct3_event_push(&ev);
+
+	if (atomic_read(&ct3_event_readers))
+		return;
+
+	if (!dev) {
+		dev_warn(ctx->dev, "%s: drm_device is null\n", __func__);
+	} else {
+		snprintf(event_string, sizeof(event_string),
+			"PANEL_IDLE_ENTER=%u,%u,%u", display_id, vrefresh, idle_te_vrefresh);
+		kobject_uevent_env(&dev->primary->kdev->kobj, KOBJ_CHANGE, envp);
+	}
+}
+EXPORT_SYMBOL_GPL(ct3_panel_idle_notification);
+
+#ifdef CT3_DSI_PROFILE
+
+#define CT3_DSI_PROF_MAX_SITES 64
+#define CT3_DSI_PROF_FUNC_LEN 40
+
+/**
+ * struct ct3_dsi_prof_site - DSI traffic sent from one function
+ */
+struct ct3_dsi_prof_site {
+	/** @key: name of the calling function, NULL if the slot is unused */
+	const char *key;
+	/** @func: copy of @key, which may belong to a panel module */
+	char func[CT3_DSI_PROF_FUNC_LEN];
+	/** @packets: number of packets */
+	u32 packets;
+	/** @flushes: number of packets which flushed the queue */
+	u32 flushes;
+	/** @bytes: payload bytes */
+	u64 bytes;
+	/** @flush_ns: total time spent waiting for flushes to complete */
+	u64 flush_ns;
+	/** @max_flush_ns: longest flush */
+	u64 max_flush_ns;
+	/** @time_ns: total time spent in DSI writes, queueing and flushing */
+	u64 time_ns;
+};
+
+DEFINE_STATIC_KEY_FALSE(ct3_dsi_prof_enabled);
+EXPORT_SYMBOL_GPL(ct3_dsi_prof_enabled);
+
+/* call sites of all ct3 drivers and of the core, open addressed by @key */
+static DEFINE_SPINLOCK(ct3_dsi_prof_lock);
+static struct ct3_dsi_prof_site ct3_dsi_prof_sites[CT3_DSI_PROF_MAX_SITES];
+/* packets from call sites that didn't fit */
+static u32 ct3_dsi_prof_dropped;
+
+/**
+ * ct3_dsi_prof_record - account one packet to the function that sent it
+ * @func: name of the panel or core function, compared by address
+ * @len: payload length
+ * @flush: the packet flushed the queue
+ * @ns: time the write took, including the flush if @flush is set
+ */
+void ct3_dsi_prof_record(const char *func, size_t len, bool flush, u64 ns)
+{
+	unsigned int i, n = hash_ptr(func, ilog2(CT3_DSI_PROF_MAX_SITES));
+	struct ct3_dsi_prof_site *site = NULL;
+	unsigned long flags;
+
+	spin_lock_irqsave(&ct3_dsi_prof_lock, flags);
+	for (i = 0; i < CT3_DSI_PROF_MAX_SITES; i++) {
+		struct ct3_dsi_prof_site *s = &ct3_dsi_prof_sites[(n + i) % CT3_DSI_PROF_MAX_SITES];
+
+		if (!s->key) {
+			s->key = func;
+			strscpy(s->func, func, sizeof(s->func));
+		}
+		if (s->key == func) {
+			site = s;
+			break;
+		}
+	}
+
+	if (site) {
+		site->packets++;
+		site->bytes += len;
+		site->time_ns += ns;
+		if (flush) {
+			site->flushes++;
+			site->flush_ns += ns;
+			site->max_flush_ns = max(site->max_flush_ns, ns);
+		}
+	} else {
+		ct3_dsi_prof_dropped++;
+	}
+	spin_unlock_irqrestore(&ct3_dsi_prof_lock, flags);
+}
+EXPORT_SYMBOL_GPL(ct3_dsi_prof_record);
+
+static int ct3_dsi_prof_cmp(const void *a, const void *b)
+{
+	const struct ct3_dsi_prof_site *sa = a, *sb = b;
+
+	/* unused slots go last */
+	if (!sa->key || !sb->key)
+		return !sa->key - !sb->key;
+
+	if (sa->bytes != sb->bytes)
+		return sa->bytes < sb->bytes ? 1 : -1;
+
+	return 0;
+}
+
+static int ct3_dsi_prof_show(struct seq_file *m, void *data)
+{
+	struct ct3_dsi_prof_site *sites;
+	struct ct3_dsi_prof_site total = { .key = "total", .func = "total" };
+	unsigned long flags;
+	unsigned int i;
+	u32 dropped;
+
+	sites = kmalloc(sizeof(ct3_dsi_prof_sites), GFP_KERNEL);
+	if (!sites)
+		return -ENOMEM;
+
+	spin_lock_irqsave(&ct3_dsi_prof_lock, flags);
+	memcpy(sites, ct3_dsi_prof_sites, sizeof(ct3_dsi_prof_sites));
+	dropped = ct3_dsi_prof_dropped;
+	spin_unlock_irqrestore(&ct3_dsi_prof_lock, flags);
+
+	sort(sites, CT3_DSI_PROF_MAX_SITES, sizeof(*sites), ct3_dsi_prof_cmp, NULL);
+
+	seq_printf(m, "enabled: %d dropped: %u\n",
+		   static_key_enabled(&ct3_dsi_prof_enabled), dropped);
+	seq_printf(m, "%-40s %8s %10s %8s %12s %12s %10s\n", "function", "packets", "bytes",
+		   "flushes", "avg_flush_us", "max_flush_us", "time_us");
+	for (i = 0; i <= CT3_DSI_PROF_MAX_SITES; i++) {
+		const struct ct3_dsi_prof_site *s = &sites[i];
+
+		/* print the sum after the last used slot, for diffing against a baseline */
+		if (i == CT3_DSI_PROF_MAX_SITES || !s->key)
+			s = &total;
+
+		seq_printf(m, "%-40s %8u %10llu %8u %12llu %12llu %10llu\n", s->func, s->packets,
+			   s->bytes, s->flushes,
+			   s->flushes ? div_u64(s->flush_ns, s->flushes * NSEC_PER_USEC) : 0,
+			   div_u64(s->max_flush_ns, NSEC_PER_USEC),
+			   div_u64(s->time_ns, NSEC_PER_USEC));
+		if (s == &total)
+			break;
+
+		total.packets += s->packets;
+		total.bytes += s->bytes;
+		total.flushes += s->flushes;
+		total.flush_ns += s->flush_ns;
+		total.max_flush_ns = max(total.max_flush_ns, s->max_flush_ns);
+		total.time_ns += s->time_ns;
+	}
+
+	kfree(sites);
+
+	return 0;
+}
+
+static int ct3_dsi_prof_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ct3_dsi_prof_show, NULL);
+}
+
+/* "1" starts and "0" stops recording, anything else resets the statistics */
+static ssize_t ct3_dsi_prof_write(struct file *file, const char __user *buf,
+				  size_t count, loff_t *ppos)
+{
+	unsigned long flags;
+	char c;
+
+	if (!count || get_user(c, buf))
+		return -EFAULT;
+
+	if (c == '1') {
+		static_branch_enable(&ct3_dsi_prof_enabled);
+	} else if (c == '0') {
+		static_branch_disable(&ct3_dsi_prof_enabled);
+	} else {
+		spin_lock_irqsave(&ct3_dsi_prof_lock, flags);
+		memset(ct3_dsi_prof_sites, 0, sizeof(ct3_dsi_prof_sites));
+		ct3_dsi_prof_dropped = 0;
+		spin_unlock_irqrestore(&ct3_dsi_prof_lock, flags);
+	}
+
+	return count;
+}
+
+static const struct file_operations ct3_dsi_prof_fops = {
+	.owner = THIS_MODULE,
+	.open = ct3_dsi_prof_open,
+	.read = seq_read,
+	.write = ct3_dsi_prof_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/**
+ * ct3_dsi_prof_debugfs_init - add the DSI profile to the debugfs of a panel
+ * @panel_root: panel debugfs directory
+ *
+ * There is a single profile for all ct3 panels and the core, it is also
+ * available as ct3/dsi_profile. Each panel directory gets a dsi_profile file
+ * for it, so that tools can keep looking it up through the connector.
+ */
+void ct3_dsi_prof_debugfs_init(struct dentry *panel_root)
+{
+	debugfs_create_file("dsi_profile", 0600, panel_root, NULL, &ct3_dsi_prof_fops);
+}
+EXPORT_SYMBOL_GPL(ct3_dsi_prof_debugfs_init);
+
+#endif /* CT3_DSI_PROFILE */
+
+static bool ct3_event_registered;
+static struct dentry *ct3_debugfs_root;
+
+static int __init ct3_core_init(void)
+{
+	ct3_debugfs_root = debugfs_create_dir("ct3", NULL);
+	debugfs_create_file("log", 0600, ct3_debugfs_root, NULL, &ct3_log_fops);
+	debugfs_create_file("te_sync", 0400, ct3_debugfs_root, NULL, &ct3_te_sync_fops);
+	debugfs_create_u32("te_sync_offset_us", 0600, ct3_debugfs_root, &ct3_te_sync_offset_us);
+#ifdef CT3_DSI_PROFILE
+	debugfs_create_file("dsi_profile", 0600, ct3_debugfs_root, NULL, &ct3_dsi_prof_fops);
+#endif
+
+	/* panels keep working with uevents only if the event device can't be added */
+	if (misc_register(&ct3_event_dev))
+		pr_warn("ct3: failed to register panel event device\n");
+	else
+		ct3_event_registered = true;
+
+	return 0;
+}
+module_init(ct3_core_init);
+
+static void __exit ct3_core_exit(void)
+{
+	if (ct3_event_registered)
+		misc_deregister(&ct3_event_dev);
+	cancel_delayed_work_sync(&ct3_event_wake);
+	cancel_delayed_work_sync(&ct3_te_sync_work);
+	cancel_work_sync(&ct3_log_dump_w);
+	debugfs_remove_recursive(ct3_debugfs_root);
+}
+module_exit(ct3_core_exit);
+
+/* header and records of a packed command sequence, NULL if they don't fit together */
+static const struct ct3_cmd_seq_hdr *ct3_cmd_seq_check(const void *data, size_t len)
+{
+	const struct ct3_cmd_seq_hdr *hdr = data;
+	const u8 *rec, *end;
+	u16 count;
+
+	if (len < sizeof(*hdr) || le32_to_cpu(hdr->magic) != CT3_CMD_SEQ_MAGIC ||
+	    le16_to_cpu(hdr->version) != CT3_CMD_SEQ_VERSION ||
+	    le32_to_cpu(hdr->size) != len - sizeof(*hdr))
+		return NULL;
+
+	rec = (const u8 *)(hdr + 1);
+	end = rec + le32_to_cpu(hdr->size);
+	for (count = 0; rec < end; count++) {
+		if (end - rec < 2 || end - rec < 2 + rec[1])
+			return NULL;
+		rec += 2 + rec[1];
+	}
+
+	return count == le16_to_cpu(hdr->count) ? hdr : NULL;
+}
+
+/*
+ * Fold "0x6F ofs" and a write to the register @w[1] wrote, when ofs continues right
+ * after the parameters @w[1] covered, into @w[1]. @w holds the four most recent
+ * records, @w[0] being the offset @w[1] was written at. Returns true if @w[2] and
+ * @w[3] were folded, they are left in the buffer past the end of @w[1].
+ */
+static bool ct3_cmd_seq_merge(u8 *const w[4])
+{
+	u8 *const ofs1 = w[0], *const reg1 = w[1], *const ofs2 = w[2], *const reg2 = w[3];
+
+	if (!ofs1 || ofs1[1] != 2 || ofs1[2] != 0x6F || ofs2[1] != 2 || ofs2[2] != 0x6F)
+		return false;
+
+	/* a delay has to stay between the two writes */
+	if (ofs1[0] || reg1[0] || ofs2[0])
+		return false;
+
+	if (reg1[1] < 2 || reg2[1] < 2 || reg1[2] != reg2[2] ||
+	    ofs2[3] != ofs1[3] + reg1[1] - 1 || reg1[1] + reg2[1] - 1 > U8_MAX)
+		return false;
+
+	memmove(reg1 + 2 + reg1[1], reg2 + 3, reg2[1] - 1);
+	reg1[0] = reg2[0];
+	reg1[1] += reg2[1] - 1;
+
+	return true;
+}
+
+/**
+ * ct3_cmd_seq_build - pack a command set for one panel revision
+ * @dev: panel device, owns the packed sequence
+ * @seq: command sequence to fill in
+ * @cmdset: command set to pack
+ * @panel_rev: panel revision to filter commands for
+ *
+ * Delay only commands are folded into the delay of the previous record. Partial
+ * writes of one register through consecutive 0x6F offsets are joined into one long
+ * write from the first offset, so that a table split across many short commands
+ * goes out as a single packet.
+ *
+ * Return: 0 on success, -E2BIG if a payload or delay doesn't fit in a record
+ */
+int ct3_cmd_seq_build(struct device *dev, struct ct3_cmd_seq *seq,
+		      const struct gs_dsi_cmdset *cmdset, u32 panel_rev)
+{
+	struct ct3_cmd_seq_hdr *hdr;
+	size_t size = 0;
+	/* most recent records, last one at the end */
+	u8 *hist[4] = {};
+	u8 *rec;
+	u16 count = 0;
+	u32 i;
+
+	for (i = 0; i < cmdset->num_cmd; i++) {
+		const struct gs_dsi_cmd *c = &cmdset->cmds[i];
+
+		if (c->cmd_len > U8_MAX || c->delay_ms > U8_MAX)
+			return -E2BIG;
+		size += 2 + c->cmd_len;
+	}
+
+	hdr = devm_kzalloc(dev, sizeof(*hdr) + size, GFP_KERNEL);
+	if (!hdr)
+		return -ENOMEM;
+
+	rec = (u8 *)(hdr + 1);
+	for (i = 0; i < cmdset->num_cmd; i++) {
+		const struct gs_dsi_cmd *c = &cmdset->cmds[i];
+
+		if (panel_rev && !(c->panel_rev & panel_rev))
+			continue;
+
+		if (!c->cmd_len && hist[3]) {
+			if (hist[3][0] + c->delay_ms > U8_MAX)
+				return -E2BIG;
+			hist[3][0] += c->delay_ms;
+			continue;
+		}
+
+		rec[0] = c->delay_ms;
+		rec[1] = c->cmd_len;
+		memcpy(rec + 2, c->cmd, c->cmd_len);
+		memmove(hist, hist + 1, sizeof(hist) - sizeof(hist[0]));
+		hist[3] = rec;
+		rec += 2 + c->cmd_len;
+		count++;
+
+		if (ct3_cmd_seq_merge(hist)) {
+			rec = hist[1] + 2 + hist[1][1];
+			count -= 2;
+			hist[3] = hist[1];
+			hist[2] = hist[0];
+			hist[1] = NULL;
+			hist[0] = NULL;
+		}
+	}
+
+	hdr->magic = cpu_to_le32(CT3_CMD_SEQ_MAGIC);
+	hdr->version = cpu_to_le16(CT3_CMD_SEQ_VERSION);
+	hdr->count = cpu_to_le16(count);
+	hdr->panel_rev = cpu_to_le32(panel_rev);
+	hdr->size = cpu_to_le32(rec - (u8 *)(hdr + 1));
+
+	if (seq->blob.data)
+		devm_kfree(dev, seq->blob.data);
+	seq->blob.data = hdr;
+	seq->blob.size = sizeof(*hdr) + le32_to_cpu(hdr->size);
+	seq->from_fw = false;
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(ct3_cmd_seq_build);
+
+/**
+ * ct3_cmd_seq_load - replace a command sequence with one from a firmware file
+ * @dev: panel device, owns the packed sequence
+ * @seq: command sequence to replace
+ * @name: firmware file name
+ * @panel_rev: panel revision the file must have been generated for
+ *
+ * Files can be generated by dumping the built in sequence from debugfs. @seq is
+ * left untouched if the file is missing or doesn't match.
+ *
+ * Return: 0 on success, negative errno otherwise
+ */
+int ct3_cmd_seq_load(struct device *dev, struct ct3_cmd_seq *seq, const char *name,
+		     u32 panel_rev)
+{
+	const struct ct3_cmd_seq_hdr *hdr;
+	const struct firmware *fw;
+	void *data;
+	int ret;
+
+	ret = firmware_request_nowarn(&fw, name, dev);
+	if (ret)
+		return ret;
+
+	hdr = ct3_cmd_seq_check(fw->data, fw->size);
+	if (!hdr) {
+		dev_warn(dev, "%s: malformed command sequence\n", name);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (panel_rev && !(le32_to_cpu(hdr->panel_rev) & panel_rev)) {
+		dev_warn(dev, "%s: generated for panel rev 0x%x, not 0x%x\n", name,
+			 le32_to_cpu(hdr->panel_rev), panel_rev);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	data = devm_kmemdup(dev, fw->data, fw->size, GFP_KERNEL);
+	if (!data) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	if (seq->blob.data)
+		devm_kfree(dev, seq->blob.data);
+	seq->blob.data = data;
+	seq->blob.size = fw->size;
+	seq->from_fw = true;
+	dev_info(dev, "%s: loaded %u commands\n", name, le16_to_cpu(hdr->count));
+out:
+	release_firmware(fw);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ct3_cmd_seq_load);
+
+/**
+ * ct3_cmd_seq_send - stream a packed command sequence
+ * @ctx: gs_panel struct
+ * @seq: command sequence
+ *
+ * Commands are queued and only flushed ahead of a delay and after the last one, so
+ * that the DSI host sends them back to back in as few HS bursts as it can. Joining
+ * the partial register writes is left to ct3_cmd_seq_build(), a sequence loaded
+ * from firmware is sent as it is.
+ *
+ * Return: 0 on success, negative errno otherwise
+ */
+int ct3_cmd_seq_send(struct gs_panel *ctx, const struct ct3_cmd_seq *seq)
+{
+	struct mipi_dsi_device *dsi = to_mipi_dsi_device(ctx->dev);
+	const struct ct3_cmd_seq_hdr *hdr = seq->blob.data;
+	const u8 *rec, *end;
+	ssize_t ret;
+
+	if (!hdr)
+		return -EINVAL;
+
+	rec = (const u8 *)(hdr + 1);
+	end = rec + le32_to_cpu(hdr->size);
+	while (rec < end) {
+		const u8 delay_ms = rec[0], len = rec[1];
+		const u8 *payload = rec + 2;
+
+		rec += 2 + len;
+		if (len) {
+			ret = gs_dsi_dcs_write_buffer(dsi, payload, len,
+						      (delay_ms || rec == end) ? 0 : GS_DSI_MSG_QUEUE);
+			if (ret < 0) {
+				dev_err(ctx->dev, "failed to send command 0x%02x (%zd)\n",
+					payload[0], ret);
+				ct3_log(ctx, CT3_LOG_CMD_ERR, payload[0], ret);
+				ct3_log_dump("command failed");
+				return ret;
+			}
+		}
+
+		if (delay_ms)
+			usleep_range(delay_ms * 1000, delay_ms * 1000 + 10);
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(ct3_cmd_seq_send);
+
+MODULE_DESCRIPTION("Shared code of the Google ct3 panel drivers");
+MODULE_LICENSE("Dual MIT/GPL");
@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Records read from /dev/ct3_panel_events.
+ *
+ * Copyright 2024 Google LLC
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#ifndef _UAPI_CT3_PANEL_EVENT_H_
+#define _UAPI_CT3_PANEL_EVENT_H_
+
+#include <linux/types.h>
+
+/**
+ * struct ct3_panel_event - record read from /dev/ct3_panel_events
+ *
+ * Each open file has its own read position and sees every record pushed after
+ * it was opened. Reads return whole records only. While the device is open, the
+ * PANEL_IDLE_ENTER uevent is not sent.
+ */
+struct ct3_panel_event {
+	/** @timestamp_ns: CLOCK_MONOTONIC time of the event */
+	__u64 timestamp_ns;
+	/** @seq: sequence number, gaps mean records were overwritten before being read */
+	__u32 seq;
+	/** @display_id: display index */
+	__u32 display_id;
+	/** @vrefresh: refresh rate of the current mode */
+	__u16 vrefresh;
+	/** @idle_vrefresh: refresh rate while idle, 0 when not idle */
+	__u16 idle_vrefresh;
+	/** @te_vrefresh: TE rate while idle */
+	__u16 te_vrefresh;
+	/** @reserved: always 0 */
+	__u16 reserved;
+};
+
+#endif /* _UAPI_CT3_PANEL_EVENT_H_ */
@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * DSI command traffic profiler for the ct3 panel drivers.
+ *
+ * Copyright 2024 Google LLC
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#ifndef _PANEL_GS_CT3_DSI_PROF_H_
+#define _PANEL_GS_CT3_DSI_PROF_H_
+
+#include <linux/debugfs.h>
+
+#include "gs_panel/gs_panel.h"
+
+#ifdef CT3_DSI_PROFILE
+
+#include <linux/jump_label.h>
+#include <linux/ktime.h>
+
+DECLARE_STATIC_KEY_FALSE(ct3_dsi_prof_enabled);
+
+void ct3_dsi_prof_record(const char *func, size_t len, bool flush, u64 ns);
+void ct3_dsi_prof_debugfs_init(struct dentry *panel_root);
+
+static inline ssize_t ct3_dsi_prof_dcs_write_buffer(struct mipi_dsi_device *dsi,
+						    const void *data, size_t len,
+						    u16 flags, const char *func)
+{
+	const bool flush = !(flags & GS_DSI_MSG_QUEUE);
+	ktime_t start;
+	ssize_t ret;
+
+	if (!static_branch_unlikely(&ct3_dsi_prof_enabled))
+		return gs_dsi_dcs_write_buffer(dsi, data, len, flags);
+
+	start = ktime_get();
+	ret = gs_dsi_dcs_write_buffer(dsi, data, len, flags);
+	ct3_dsi_prof_record(func, len, flush, ktime_to_ns(ktime_sub(ktime_get(), start)));
+
+	return ret;
+}
+
+/*
+ * Route the GS_DCS_* macros through the profiler. They expand in the calling
+ * function, so __func__ names the panel code path that queued the packet.
+ */
+#define gs_dsi_dcs_write_buffer(dsi, data, len, flags) \
+	ct3_dsi_prof_dcs_write_buffer(dsi, data, len, flags, __func__)
+
+/* for helpers writing on behalf of @func, so traffic isn't attributed to them */
+#define ct3_dsi_write_buffer_caller(dsi, data, len, flags, func) \
+	ct3_dsi_prof_dcs_write_buffer(dsi, data, len, flags, func)
+
+#else /* CT3_DSI_PROFILE */
+
+#define ct3_dsi_write_buffer_caller(dsi, data, len, flags, func) \
+	gs_dsi_dcs_write_buffer(dsi, data, len, flags)
+
+static inline void ct3_dsi_prof_debugfs_init(struct dentry *panel_root) { }
+
+#endif /* CT3_DSI_PROFILE */
+
+/* GS_DCS_BUF_ADD_CMD() with the packet attributed to @func */
+#define CT3_DCS_BUF_ADD_CMD_CALLER(dev, func, seq...) do {			\
+	const u8 d[] = { seq };							\
+	ct3_dsi_write_buffer_caller(to_mipi_dsi_device(dev), d, ARRAY_SIZE(d),	\
+				    GS_DSI_MSG_QUEUE, func);			\
+} while (0)
+
+/* GS_DCS_BUF_ADD_CMD_AND_FLUSH() with the packet attributed to @func */
+#define CT3_DCS_BUF_ADD_CMD_AND_FLUSH_CALLER(dev, func, seq...) do {		\
+	const u8 d[] = { seq };							\
+	ct3_dsi_write_buffer_caller(to_mipi_dsi_device(dev), d, ARRAY_SIZE(d),	\
+				    0, func);					\
+} while (0)
+
+#endif /* _PANEL_GS_CT3_DSI_PROF_H_ */
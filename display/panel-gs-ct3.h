@@ -0,0 +1,729 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Shared helpers for the gs_panel based ct3 panel drivers.
+ *
+ * Copyright 2024 Google LLC
+ *
+ * Use of this source code is governed by an MIT-style
+ * license that can be found in the LICENSE file or at
+ * https://opensource.org/licenses/MIT.
+ */
+
+#ifndef _PANEL_GS_CT3_H_
+#define _PANEL_GS_CT3_H_
+
+#include <linux/atomic.h>
+#include <linux/backlight.h>
+#include <linux/bits.h>
+#include <linux/debugfs.h>
+#include <linux/input.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/of.h>
+#include <linux/string.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <video/mipi_display.h>
+
+#include <drm/ct3_panel_event.h>
+
+#include "gs_panel/gs_panel.h"
+
+#include "panel-gs-ct3-dsi-prof.h"
+
+/**
+ * __ct3_brightness_commit - queue the DBV and flush the brightness transaction
+ * @ctx: gs_panel struct
+ * @br: display brightness value
+ * @func: caller the DSI traffic is attributed to when profiling
+ *
+ * Registers that depend on the brightness level (ACD, gamma, ECC, ELVSS) are
+ * expected to be queued with GS_DCS_BUF_ADD_CMD() before calling this, so they
+ * go out in the same DSI transfer as the new DBV and the panel latches all of
+ * them on the same frame.
+ */
+static inline void __ct3_brightness_commit(struct gs_panel *ctx, u16 br, const char *func)
+{
+	CT3_DCS_BUF_ADD_CMD_AND_FLUSH_CALLER(ctx->dev, func, MIPI_DCS_SET_DISPLAY_BRIGHTNESS,
+					     br >> 8, br & 0xff);
+}
+
+/* a macro, so that DSI profiling attributes the traffic to the caller */
+#define ct3_brightness_commit(ctx, br) __ct3_brightness_commit(ctx, br, __func__)
+
+/* register byte plus the longest cached parameter list */
+#define CT3_SHADOW_REG_MAX_LEN 13
+#define CT3_SHADOW_NUM_REGS 16
+
+/**
+ * struct ct3_shadow_reg - last value written to one paged register
+ */
+struct ct3_shadow_reg {
+	/** @page: page selected through 0xF0 */
+	u8 page;
+	/** @offset: parameter offset selected through 0x6F */
+	u8 offset;
+	/** @len: number of valid bytes in @data */
+	u8 len;
+	/** @data: register followed by its parameters */
+	u8 data[CT3_SHADOW_REG_MAX_LEN];
+};
+
+/**
+ * struct ct3_shadow - shadow copy of paged panel registers
+ *
+ * Tracks the last value written through ct3_shadow_write() for each
+ * (page, 0x6F offset, register) tuple so that writes which leave the panel
+ * unchanged can be dropped. The cache has to be invalidated whenever the panel
+ * loses its register state, i.e. on reset and disable.
+ */
+struct ct3_shadow {
+	/** @enabled: drop writes that match the cached value */
+	bool enabled;
+	/** @cur_page: page selected in the batch being built, -1 if unknown */
+	int cur_page;
+	/** @num_regs: number of valid entries in @regs */
+	unsigned int num_regs;
+	/** @regs: cached register values */
+	struct ct3_shadow_reg regs[CT3_SHADOW_NUM_REGS];
+	/** @tx_packets: number of packets queued through the cache */
+	u32 tx_packets;
+	/** @tx_bytes: number of payload bytes queued through the cache */
+	u64 tx_bytes;
+};
+
+static inline void ct3_shadow_invalidate(struct ct3_shadow *sh)
+{
+	sh->num_regs = 0;
+	sh->cur_page = -1;
+}
+
+/**
+ * ct3_shadow_begin - start a sequence of shadowed writes
+ * @sh: shadow cache
+ *
+ * Forgets the currently selected page, so that the first write of the sequence
+ * selects it again. Must be called whenever other code may have sent a page
+ * select since the last shadowed write.
+ */
+static inline void ct3_shadow_begin(struct ct3_shadow *sh)
+{
+	sh->cur_page = -1;
+}
+
+static inline struct ct3_shadow_reg *ct3_shadow_lookup(struct ct3_shadow *sh, u8 page,
+							u8 offset, u8 reg)
+{
+	unsigned int i;
+
+	for (i = 0; i < sh->num_regs; i++) {
+		struct ct3_shadow_reg *r = &sh->regs[i];
+
+		if (r->page == page && r->offset == offset && r->data[0] == reg)
+			return r;
+	}
+
+	if (sh->num_regs == CT3_SHADOW_NUM_REGS)
+		return NULL;
+
+	return &sh->regs[sh->num_regs++];
+}
+
+/**
+ * __ct3_shadow_write - queue a paged register write unless it is redundant
+ * @dev: panel device
+ * @sh: shadow cache
+ * @page: page selected through 0xF0
+ * @offset: parameter offset selected through 0x6F, 0 for none
+ * @data: register followed by its parameters
+ * @len: length of @data
+ * @force: queue the write even if the cached value matches
+ * @func: caller the DSI traffic is attributed to when profiling
+ *
+ * Called through ct3_shadow_write() or CT3_SHADOW_WRITE(). The page select
+ * and the offset are only queued along with a register write that actually
+ * goes out.
+ *
+ * Return: true if the write was queued
+ */
+static inline bool __ct3_shadow_write(struct device *dev, struct ct3_shadow *sh, u8 page,
+				      u8 offset, const u8 *data, size_t len, bool force,
+				      const char *func)
+{
+	struct ct3_shadow_reg *r = NULL;
+
+	if (len <= CT3_SHADOW_REG_MAX_LEN) {
+		r = ct3_shadow_lookup(sh, page, offset, data[0]);
+		if (sh->enabled && !force && r && r->len == len && !memcmp(r->data, data, len))
+			return false;
+	}
+
+	if (sh->cur_page != page) {
+		CT3_DCS_BUF_ADD_CMD_CALLER(dev, func, 0xF0, 0x55, 0xAA, 0x52, 0x08, page);
+		sh->cur_page = page;
+		sh->tx_packets++;
+		sh->tx_bytes += 6;
+	}
+	if (offset) {
+		CT3_DCS_BUF_ADD_CMD_CALLER(dev, func, 0x6F, offset);
+		sh->tx_packets++;
+		sh->tx_bytes += 2;
+	}
+	ct3_dsi_write_buffer_caller(to_mipi_dsi_device(dev), data, len, GS_DSI_MSG_QUEUE, func);
+	sh->tx_packets++;
+	sh->tx_bytes += len;
+
+	if (r) {
+		r->page = page;
+		r->offset = offset;
+		r->len = len;
+		memcpy(r->data, data, len);
+	}
+
+	return true;
+}
+
+#define ct3_shadow_write(dev, sh, page, offset, data, len, force) \
+	__ct3_shadow_write(dev, sh, page, offset, data, len, force, __func__)
+
+#define CT3_SHADOW_WRITE(dev, sh, page, offset, force, seq...) do {	\
+	const u8 d[] = { seq };						\
+	ct3_shadow_write(dev, sh, page, offset, d, ARRAY_SIZE(d), force);	\
+} while (0)
+
+/**
+ * enum ct3_zone_reg - register groups whose value depends on the DBV zone
+ * @CT3_ZONE_REG_GAMMA: gamma setting
+ * @CT3_ZONE_REG_ECC: edge compensation setting
+ * @CT3_ZONE_REG_ACD: ACD level
+ * @CT3_ZONE_REG_IRC: IRC setting
+ * @CT3_ZONE_REG_MAX: number of register groups
+ */
+enum ct3_zone_reg {
+	CT3_ZONE_REG_GAMMA,
+	CT3_ZONE_REG_ECC,
+	CT3_ZONE_REG_ACD,
+	CT3_ZONE_REG_IRC,
+	CT3_ZONE_REG_MAX,
+};
+
+#define CT3_DBV_ZONE_NONE (-1)
+#define CT3_DBV_MAX_ZONES 8
+
+/* zone is only entered and left on exact DBV match, hysteresis doesn't apply */
+#define CT3_DBV_ZONE_EXACT BIT(0)
+
+/* default DBV codes past a zone edge before leaving the current zone */
+#define CT3_DBV_ZONE_HYSTERESIS 4
+
+/**
+ * struct ct3_dbv_zone - DBV zone and the register configuration used in it
+ */
+struct ct3_dbv_zone {
+	/** @min_dbv: lowest DBV of the zone, the zone ends where the next one starts */
+	u16 min_dbv;
+	/** @flags: CT3_DBV_ZONE_* flags */
+	u8 flags;
+	/** @cfg: panel specific configuration index for each &enum ct3_zone_reg */
+	u8 cfg[CT3_ZONE_REG_MAX];
+};
+
+/**
+ * struct ct3_dbv_zone_table - sorted DBV zones of one panel revision
+ */
+struct ct3_dbv_zone_table {
+	/** @num_zones: number of valid entries in @zones, 0 if zones aren't used */
+	unsigned int num_zones;
+	/** @max_dbv: highest DBV of the last zone */
+	u16 max_dbv;
+	/** @hysteresis: DBV codes past a zone edge before leaving the current zone */
+	u16 hysteresis;
+	/** @zones: zones sorted by ascending &ct3_dbv_zone.min_dbv */
+	struct ct3_dbv_zone zones[CT3_DBV_MAX_ZONES];
+};
+
+/**
+ * ct3_dbv_zone_table_init - load a DBV zone table
+ * @dev: panel device, its DT node may override the default thresholds
+ * @t: table to initialize
+ * @zones: default zones, sorted by ascending DBV
+ * @num_zones: number of entries in @zones
+ * @max_dbv: highest DBV of the last zone
+ *
+ * The zone thresholds can be tuned through the "google,dbv-zone-thresholds"
+ * property, which lists the lowest DBV of each zone, and the hysteresis through
+ * "google,dbv-zone-hysteresis", CT3_DBV_ZONE_HYSTERESIS if not set. Thresholds
+ * that aren't strictly ascending are rejected in favor of the defaults.
+ */
+static inline void ct3_dbv_zone_table_init(struct device *dev, struct ct3_dbv_zone_table *t,
+					   const struct ct3_dbv_zone *zones,
+					   unsigned int num_zones, u16 max_dbv)
+{
+	u32 thresholds[CT3_DBV_MAX_ZONES];
+	u32 hysteresis = CT3_DBV_ZONE_HYSTERESIS;
+	unsigned int i;
+
+	if (WARN_ON(num_zones > CT3_DBV_MAX_ZONES))
+		num_zones = CT3_DBV_MAX_ZONES;
+
+	memcpy(t->zones, zones, num_zones * sizeof(*zones));
+	t->num_zones = num_zones;
+	t->max_dbv = max_dbv;
+
+	of_property_read_u32(dev->of_node, "google,dbv-zone-hysteresis", &hysteresis);
+	t->hysteresis = hysteresis;
+
+	if (!num_zones || of_property_read_u32_array(dev->of_node, "google,dbv-zone-thresholds",
+						     thresholds, num_zones))
+		return;
+
+	for (i = 0; i < num_zones; i++) {
+		if (thresholds[i] > max_dbv || (i && thresholds[i] <= thresholds[i - 1])) {
+			dev_warn(dev, "invalid dbv zone thresholds, use default\n");
+			return;
+		}
+	}
+
+	for (i = 0; i < num_zones; i++)
+		t->zones[i].min_dbv = thresholds[i];
+}
+
+/**
+ * ct3_dbv_zone_find - look up the zone containing a DBV
+ * @t: zone table
+ * @br: DBV
+ *
+ * Return: index of the zone, CT3_DBV_ZONE_NONE if @br isn't covered by the table
+ */
+static inline int ct3_dbv_zone_find(const struct ct3_dbv_zone_table *t, u16 br)
+{
+	int lo = 0, hi = (int)t->num_zones - 1;
+
+	if (!t->num_zones || br < t->zones[0].min_dbv || br > t->max_dbv)
+		return CT3_DBV_ZONE_NONE;
+
+	while (lo < hi) {
+		const int mid = (lo + hi + 1) / 2;
+
+		if (t->zones[mid].min_dbv <= br)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	return lo;
+}
+
+/**
+ * ct3_dbv_zone_select - pick the zone for a new DBV, applying hysteresis
+ * @t: zone table
+ * @cur: current zone index, CT3_DBV_ZONE_NONE if unknown
+ * @br: new DBV
+ *
+ * The current zone is kept as long as @br is no more than &ct3_dbv_zone_table.hysteresis
+ * codes outside of it, so that brightness jitter around a zone edge doesn't
+ * toggle the zone dependent registers on every update.
+ *
+ * Return: index of the selected zone, CT3_DBV_ZONE_NONE if @br is out of range
+ */
+static inline int ct3_dbv_zone_select(const struct ct3_dbv_zone_table *t, int cur, u16 br)
+{
+	const int req = ct3_dbv_zone_find(t, br);
+	u32 lo, hi;
+
+	if (req == CT3_DBV_ZONE_NONE || cur == CT3_DBV_ZONE_NONE || req == cur ||
+	    !t->hysteresis || (unsigned int)cur >= t->num_zones)
+		return req;
+
+	if ((t->zones[cur].flags | t->zones[req].flags) & CT3_DBV_ZONE_EXACT)
+		return req;
+
+	lo = t->zones[cur].min_dbv;
+	hi = ((unsigned int)cur + 1 < t->num_zones) ? t->zones[cur + 1].min_dbv - 1 : t->max_dbv;
+	if (br + t->hysteresis >= lo && br <= hi + t->hysteresis)
+		return cur;
+
+	return req;
+}
+
+/**
+ * ct3_dbv_zone_diff - get the register groups that differ between two zones
+ * @t: zone table
+ * @old: previous zone index, CT3_DBV_ZONE_NONE if unknown
+ * @new: new zone index
+ *
+ * Return: bitmask of &enum ct3_zone_reg groups which have to be rewritten
+ */
+static inline unsigned long ct3_dbv_zone_diff(const struct ct3_dbv_zone_table *t,
+					      int old, int new)
+{
+	unsigned long diff = 0;
+	int i;
+
+	if (new == CT3_DBV_ZONE_NONE || old == new)
+		return 0;
+
+	if (old == CT3_DBV_ZONE_NONE)
+		return GENMASK(CT3_ZONE_REG_MAX - 1, 0);
+
+	for (i = 0; i < CT3_ZONE_REG_MAX; i++) {
+		if (t->zones[old].cfg[i] != t->zones[new].cfg[i])
+			diff |= BIT(i);
+	}
+
+	return diff;
+}
+
+/**
+ * struct ct3_te - TE interrupt of a panel, used to wait for vblank without a CRTC
+ *
+ * Only used with a TE line of the panel's own, the TE input of the DSI host
+ * belongs to decon. The interrupt is enabled while waiting for a pulse, the
+ * handler records the pulse and wakes the waiters.
+ */
+struct ct3_te {
+	/** @irq: TE interrupt, negative if there is no TE gpio */
+	int irq;
+	/** @count: number of TE pulses seen */
+	u32 count;
+	/** @timestamp: time of the last TE pulse */
+	ktime_t timestamp;
+	/** @wq: waiters for the next TE pulse */
+	wait_queue_head_t wq;
+};
+
+void ct3_te_init(struct device *dev, struct ct3_te *te);
+int ct3_te_wait(struct ct3_te *te, u32 timeout_us);
+void ct3_wait_one_vblank(struct gs_panel *ctx, struct ct3_te *te);
+
+/* follower TE may fire at most this long before its own frame starts */
+#define CT3_TE_SYNC_MAX_ADVANCE_US 2000
+
+/**
+ * enum ct3_te_sync_role - part a panel plays in dual display TE phase lock
+ * @CT3_TE_SYNC_LEADER: TE phase reference, never moved
+ * @CT3_TE_SYNC_FOLLOWER: TE is moved to trail the leader by the configured offset
+ * @CT3_TE_SYNC_ROLE_MAX: number of roles
+ */
+enum ct3_te_sync_role {
+	CT3_TE_SYNC_LEADER,
+	CT3_TE_SYNC_FOLLOWER,
+	CT3_TE_SYNC_ROLE_MAX,
+};
+
+/**
+ * struct ct3_te_sync - TE phase lock state of one panel
+ *
+ * While both panels scan out at the same TE rate, the follower's TE is moved
+ * so that the two DPUs fetch their frames one after the other instead of in
+ * the same window.
+ */
+struct ct3_te_sync {
+	/** @ctx: panel, NULL while not registered */
+	struct gs_panel *ctx;
+	/** @te: TE interrupt the phase is measured with */
+	struct ct3_te *te;
+	/** @role: leader or follower */
+	enum ct3_te_sync_role role;
+	/** @max_advance_us: how far the follower's TE may move ahead of its frame start */
+	u32 max_advance_us;
+	/** @advance_us: follower: time its TE currently fires before its frame starts */
+	u32 advance_us;
+	/** @paired: both panels are active at the same TE rate */
+	bool paired;
+	/**
+	 * @apply: called when @paired or @advance_us changed, reprograms the TE of an
+	 * active panel. Runs with the core's TE phase lock mutex held, so it may take
+	 * the panel mode_lock but must not call back into ct3_te_sync_*().
+	 */
+	void (*apply)(struct gs_panel *ctx);
+};
+
+int ct3_te_sync_register(struct device *dev, struct ct3_te_sync *sync);
+void ct3_te_sync_update(const struct ct3_te_sync *sync);
+u32 ct3_te_sync_advance_lines(const struct ct3_te_sync *sync,
+			      const struct drm_display_mode *mode);
+
+static inline bool ct3_te_sync_paired(const struct ct3_te_sync *sync)
+{
+	return READ_ONCE(sync->paired);
+}
+
+#define CT3_FFC_MAX_RATES 4
+
+/**
+ * struct ct3_ffc_payload - FFC (frame frequency compensation) setting for one DSI rate
+ */
+struct ct3_ffc_payload {
+	/** @hs_clk_mbps: DSI lane rate */
+	u32 hs_clk_mbps;
+	/** @cmd: 0xC3 register followed by its parameters */
+	const u8 *cmd;
+	/** @len: length of @cmd */
+	size_t len;
+};
+
+#define CT3_FFC_PAYLOAD(mbps, seq) { .hs_clk_mbps = mbps, .cmd = seq, .len = ARRAY_SIZE(seq) }
+
+/**
+ * struct ct3_ffc - DSI clock hopping state of a panel
+ *
+ * Only panels with a characterized FFC setting for every rate hop.
+ */
+struct ct3_ffc {
+	/** @payloads: prebuilt FFC settings */
+	const struct ct3_ffc_payload *payloads;
+	/** @num_payloads: number of entries in @payloads */
+	unsigned int num_payloads;
+	/** @page: CMD2 page holding the 0xC3 FFC register */
+	u8 page;
+	/** @num_rates: number of valid entries in @rates */
+	unsigned int num_rates;
+	/** @rates: DSI rates the panel may hop between */
+	u32 rates[CT3_FFC_MAX_RATES];
+};
+
+void ct3_ffc_init(struct device *dev, struct ct3_ffc *ffc,
+		  const struct ct3_ffc_payload *payloads,
+		  unsigned int num_payloads, u8 page);
+bool ct3_ffc_rate_allowed(const struct ct3_ffc *ffc, u32 hs_clk_mbps);
+void ct3_ffc_pre_update(struct gs_panel *ctx, const struct ct3_ffc *ffc);
+void ct3_ffc_update(struct gs_panel *ctx, const struct ct3_ffc *ffc, u32 hs_clk_mbps);
+
+/* time a pre-warmed panel waits for prepare before powering off again */
+#define CT3_PREWARM_TIMEOUT_MS 1000
+
+/**
+ * enum ct3_prewarm_state - state of the speculative power on while unfolding
+ * @CT3_PREWARM_NONE: panel power is only controlled by the drm core
+ * @CT3_PREWARM_READY: panel is powered and out of reset, waiting for prepare
+ * @CT3_PREWARM_CLAIMED: prepare took over the pre-warmed panel, enable skips reset
+ */
+enum ct3_prewarm_state {
+	CT3_PREWARM_NONE,
+	CT3_PREWARM_READY,
+	CT3_PREWARM_CLAIMED,
+};
+
+/**
+ * struct ct3_prewarm - hall sensor driven pre-warm while the device unfolds
+ */
+struct ct3_prewarm {
+	/** @ctx: panel to pre-warm */
+	struct gs_panel *ctx;
+	/** @lock: protects @state and @prepared */
+	struct mutex lock;
+	/** @state: current pre-warm state */
+	enum ct3_prewarm_state state;
+	/** @prepared: panel power is on */
+	bool prepared;
+	/** @registered: @handler is registered */
+	bool registered;
+	/** @timeout_ms: time to wait for prepare before powering off again */
+	u32 timeout_ms;
+	/** @sensor: hall sensor node, only its lid switch is listened to */
+	struct device_node *sensor;
+	/** @work: powers the panel on after the hinge starts opening */
+	struct work_struct work;
+	/** @timeout_work: powers a pre-warmed panel off if not claimed */
+	struct delayed_work timeout_work;
+	/** @handler: listens for hall sensor lid switch events */
+	struct input_handler handler;
+};
+
+void ct3_prewarm_init(struct gs_panel *ctx, struct ct3_prewarm *pw);
+void ct3_prewarm_register(struct ct3_prewarm *pw);
+void ct3_prewarm_remove(struct ct3_prewarm *pw);
+int ct3_prewarm_prepare(struct ct3_prewarm *pw);
+int ct3_prewarm_unprepare(struct ct3_prewarm *pw);
+void ct3_prewarm_reset(struct ct3_prewarm *pw);
+
+int ct3_input_connect(struct input_handler *handler, struct input_dev *dev,
+		      const struct input_device_id *id);
+void ct3_input_disconnect(struct input_handle *handle);
+
+/* brightness change that is pushed to the thermal zone right away */
+#define CT3_BL_PUSH_DELTA 64
+
+/**
+ * struct ct3_bl_snapshot - brightness published to the brightness thermal zone
+ *
+ * The thermal callback reads @brightness without taking bl_state_lock, so thermal
+ * polling doesn't contend with brightness updates on the commit thread.
+ */
+struct ct3_bl_snapshot {
+	/** @ctx: panel the snapshot belongs to */
+	struct gs_panel *ctx;
+	/** @brightness: effective brightness, 0 in standby, negative until published */
+	atomic_t brightness;
+	/** @pushed: brightness last pushed to the thermal zone */
+	int pushed;
+	/** @removed: set once the thermal zone may go away, @work doesn't push anymore */
+	bool removed;
+	/** @work: pushes significant changes to the thermal zone */
+	struct work_struct work;
+};
+
+int ct3_bl_snapshot_init(struct device *dev, struct ct3_bl_snapshot *snap,
+			 struct gs_panel *ctx);
+void ct3_bl_snapshot_remove(struct ct3_bl_snapshot *snap);
+
+/**
+ * ct3_bl_publish - update the brightness snapshot
+ * @snap: brightness snapshot
+ * @brightness: new effective brightness, 0 in standby
+ *
+ * Entering or leaving standby and large steps are pushed to the thermal zone
+ * from a work item, smaller steps are picked up by the next poll.
+ */
+static inline void ct3_bl_publish(struct ct3_bl_snapshot *snap, int brightness)
+{
+	const int pushed = READ_ONCE(snap->pushed);
+
+	if (atomic_xchg(&snap->brightness, brightness) == brightness)
+		return;
+
+	if (!brightness != !pushed || abs(brightness - pushed) >= CT3_BL_PUSH_DELTA)
+		schedule_work(&snap->work);
+}
+
+/*
+ * publish the brightness as seen by the backlight device, read without bl_state_lock
+ * from the brightness and enable paths which run after the properties are updated
+ */
+static inline void ct3_bl_publish_state(struct ct3_bl_snapshot *snap)
+{
+	const struct backlight_device *bl = snap->ctx->bl;
+
+	if (bl)
+		ct3_bl_publish(snap, (bl->props.state & BL_STATE_STANDBY) ?
+				     0 : bl->props.brightness);
+}
+
+int ct3_bl_get_brightness(struct ct3_bl_snapshot *snap, int *temp);
+int ct3_bl_thermal_init(struct device *dev, struct ct3_bl_snapshot *snap, const char *type);
+
+/* default brightness ramp length, what 32 frames used to take at 120Hz */
+#define CT3_DIMMING_MS 267
+
+/**
+ * struct ct3_dimming - brightness dimming specified as a duration
+ *
+ * The DDIC ramps brightness over a number of frames, which is recomputed from
+ * the refresh rate so that a ramp takes about @duration_ms at any rate.
+ */
+struct ct3_dimming {
+	/** @duration_ms: target ramp length */
+	u32 duration_ms;
+	/** @frames: frame count programmed into the DDIC, 0 if unknown */
+	u8 frames;
+	/** @vrefresh: refresh rate @frames was computed for */
+	u32 vrefresh;
+	/** @end: time the last brightness ramp finishes */
+	ktime_t end;
+};
+
+bool ct3_dimming_update(struct ct3_dimming *dim, u32 vrefresh);
+ktime_t ct3_dimming_start(struct ct3_dimming *dim);
+bool ct3_dimming_busy(const struct gs_panel *ctx, const struct ct3_dimming *dim);
+
+bool ct3_is_auto_mode_allowed(struct gs_panel *ctx, const struct ct3_dimming *dim);
+u32 ct3_get_min_idle_vrefresh(struct gs_panel *ctx, const struct gs_panel_mode *pmode,
+			      const struct ct3_dimming *dim, u32 floor_hz);
+void ct3_panel_idle_notification(struct gs_panel *ctx, u32 display_id, u32 vrefresh,
+				 u32 idle_te_vrefresh);
+
+/**
+ * struct ct3_vrr_funcs - panel specific steps of the shared VRR/idle state machine
+ */
+struct ct3_vrr_funcs {
+	/** @update_refresh_mode: enter auto mode at an idle rate, or manual mode for 0 */
+	void (*update_refresh_mode)(struct gs_panel *ctx, const struct gs_panel_mode *pmode,
+				    u32 idle_vrefresh);
+	/** @get_min_idle_vrefresh: lowest rate auto mode may drop to, 0 to not use it */
+	u32 (*get_min_idle_vrefresh)(struct gs_panel *ctx, const struct gs_panel_mode *pmode);
+	/** @get_auto_mode_vrefresh: idle rate currently set, 0 in manual mode */
+	u32 (*get_auto_mode_vrefresh)(struct gs_panel *ctx);
+	/** @send_early_exit: make the panel leave idle on the next frame, staying in auto mode */
+	void (*send_early_exit)(struct gs_panel *ctx);
+	/** @set_lp_self_refresh: optional, LP mode self refresh changed */
+	void (*set_lp_self_refresh)(struct gs_panel *ctx, bool enable);
+};
+
+/**
+ * struct ct3_vrr - shared VRR/idle state machine of a panel
+ */
+struct ct3_vrr {
+	/** @funcs: panel specific steps */
+	const struct ct3_vrr_funcs *funcs;
+	/** @te: TE of the panel, to wait for a frame after leaving idle */
+	struct ct3_te *te;
+};
+
+bool ct3_set_self_refresh(struct gs_panel *ctx, const struct ct3_vrr *vrr, bool enable);
+bool ct3_early_exit(struct gs_panel *ctx, const struct ct3_vrr *vrr, bool force_changeable_te);
+
+/**
+ * enum ct3_log_event - state transitions recorded in the ct3 event log
+ * @CT3_LOG_REFRESH: refresh mode set, mode vrefresh and idle vrefresh
+ * @CT3_LOG_FREQ: refresh rate changed, vrefresh and op_hz
+ * @CT3_LOG_FFC: DSI clock hopped, new and previous rate in Mbps
+ * @CT3_LOG_TE_TIMEOUT: no TE pulse, TE rate and timeout in us
+ * @CT3_LOG_CMD_ERR: command failed, command and errno
+ * @CT3_LOG_TE_SYNC: follower TE moved, measured phase and new advance in us
+ * @CT3_LOG_READ_ERR: register read failed, register and errno or short length
+ * @CT3_LOG_MAX: number of events
+ */
+enum ct3_log_event {
+	CT3_LOG_REFRESH,
+	CT3_LOG_FREQ,
+	CT3_LOG_FFC,
+	CT3_LOG_TE_TIMEOUT,
+	CT3_LOG_CMD_ERR,
+	CT3_LOG_TE_SYNC,
+	CT3_LOG_READ_ERR,
+	CT3_LOG_MAX,
+};
+
+void ct3_log(const struct gs_panel *ctx, enum ct3_log_event event, u32 a, u32 b);
+void ct3_log_dump(const char *reason);
+
+#define CT3_CMD_SEQ_MAGIC 0x53335443 /* "CT3S" */
+#define CT3_CMD_SEQ_VERSION 1
+
+/**
+ * struct ct3_cmd_seq_hdr - header of a packed command sequence
+ *
+ * Followed by @count records of one byte delay in ms, one byte payload length
+ * and the DCS payload. Records are already filtered for @panel_rev.
+ */
+struct ct3_cmd_seq_hdr {
+	/** @magic: CT3_CMD_SEQ_MAGIC */
+	__le32 magic;
+	/** @version: CT3_CMD_SEQ_VERSION */
+	__le16 version;
+	/** @count: number of records */
+	__le16 count;
+	/** @panel_rev: panel revisions the records apply to */
+	__le32 panel_rev;
+	/** @size: size of the records, in bytes */
+	__le32 size;
+} __packed;
+
+/**
+ * struct ct3_cmd_seq - command sequence streamed without per command lookups
+ */
+struct ct3_cmd_seq {
+	/** @blob: header and records, exposed in debugfs to generate firmware files */
+	struct debugfs_blob_wrapper blob;
+	/** @from_fw: sequence was loaded with request_firmware */
+	bool from_fw;
+};
+
+int ct3_cmd_seq_build(struct device *dev, struct ct3_cmd_seq *seq,
+		      const struct gs_dsi_cmdset *cmdset, u32 panel_rev);
+int ct3_cmd_seq_load(struct device *dev, struct ct3_cmd_seq *seq, const char *name,
+		     u32 panel_rev);
+int ct3_cmd_seq_send(struct gs_panel *ctx, const struct ct3_cmd_seq *seq);
+
+#endif /* _PANEL_GS_CT3_H_ */
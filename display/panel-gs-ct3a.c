@@ -5,7 +5,6 @@
 #include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/module.h>
-#include <linux/thermal.h>
 #include <video/mipi_display.h>
 
 #include "trace/panel_trace.h"
@@ -14,6 +13,8 @@
 #include "gs_panel/gs_panel.h"
 #include "gs_panel/gs_panel_funcs_defaults.h"
 
+#include "panel-gs-ct3.h"
+
 #define VLIN_CMD_SIZE 3
 
 /* one frame durtion(us) at 30Hz */
@@ -25,6 +26,38 @@ static const u8 vgh_7v1[]  = { 0xF4, 0x15, 0x15, 0x15, 0x15 };
 static const u8 vgh_7v4[]  = { 0xF4, 0x18, 0x18, 0x18, 0x18 };
 static const u8 vreg_6v9[] = { 0xF4, 0x18 };
 
+/**
+ * struct ct3a_payload - command whose length differs between panel revisions
+ */
+struct ct3a_payload {
+	/** @len: payload length, 0 if the revision doesn't need the command */
+	u8 len;
+	/** @cmd: command and parameters */
+	u8 cmd[5];
+};
+
+#define CT3A_PAYLOAD(seq...) { .len = sizeof((u8[]){ seq }), .cmd = { seq } }
+
+/**
+ * struct ct3a_rev_ops - register values that differ between panel revisions
+ */
+struct ct3a_rev_ops {
+	/** @te_fixed: 0xB9 setting ahead of fixed TE in early exit */
+	struct ct3a_payload te_fixed;
+	/** @te_changeable: 0xB9 setting for changeable TE */
+	struct ct3a_payload te_changeable;
+	/** @fi_step_ns: offset of the auto mode step control in NS */
+	struct ct3a_payload fi_step_ns;
+	/** @fi_step_hs: offset of the auto mode step control in HS */
+	struct ct3a_payload fi_step_hs;
+	/** @manual_ns_1hz: 0x60 setting for manual 1Hz in NS */
+	u8 manual_ns_1hz;
+	/** @manual_hs_30hz: 0x60 setting for manual 30Hz in HS */
+	u8 manual_hs_30hz;
+	/** @manual_hs_60hz: 0x60 setting for manual 60Hz in HS */
+	u8 manual_hs_60hz;
+};
+
 /**
  * struct ct3a_panel - panel specific runtime info
  *
@@ -57,6 +90,16 @@ struct ct3a_panel {
 	struct panel_voltage {
 		u8 vlin_default[VLIN_CMD_SIZE];
 	} panel_voltage;
+	/** @te: TE interrupt used to wait for the next frame */
+	struct ct3_te te;
+	/** @vrr: shared VRR/idle state machine */
+	struct ct3_vrr vrr;
+	/** @bl_snapshot: brightness read by the thermal zone */
+	struct ct3_bl_snapshot bl_snapshot;
+	/** @rev_ops: revision specific register values, resolved once panel_rev is known */
+	const struct ct3a_rev_ops *rev_ops;
+	/** @prewarm: hall sensor driven pre-warm while the device unfolds */
+	struct ct3_prewarm prewarm;
 };
 
 #define to_spanel(ctx) container_of(ctx, struct ct3a_panel, base)
@@ -221,49 +264,46 @@ static void ct3a_update_te2(struct gs_panel *ctx)
 		ctx->idle_data.panel_idle_vrefresh);
 }
 
-static inline bool is_auto_mode_allowed(struct gs_panel *ctx)
-{
-	/* don't want to enable auto mode/early exit during dimming on */
-	if (ctx->dimming_on)
-		return false;
+static const struct ct3a_rev_ops ct3a_rev_ops_proto1 = {
+	.te_fixed = CT3A_PAYLOAD(0xB9, 0x51, 0x51, 0x00, 0x00),
+	.te_changeable = CT3A_PAYLOAD(0xB9, 0x00, 0x51, 0x00, 0x00),
+	.manual_ns_1hz = 0x1D,
+	.manual_hs_30hz = 0x02,
+	.manual_hs_60hz = 0x01,
+};
 
-	if (ctx->idle_data.idle_delay_ms) {
-		const unsigned int delta_ms = gs_panel_get_idle_time_delta(ctx);
+static const struct ct3a_rev_ops ct3a_rev_ops_proto1_1 = {
+	.te_fixed = CT3A_PAYLOAD(0xB9, 0x51, 0x51, 0x00, 0x00),
+	.te_changeable = CT3A_PAYLOAD(0xB9, 0x04, 0x51, 0x00, 0x00),
+	.manual_ns_1hz = 0x1D,
+	.manual_hs_30hz = 0x02,
+	.manual_hs_60hz = 0x01,
+};
 
-		if (delta_ms < ctx->idle_data.idle_delay_ms)
-			return false;
-	}
+static const struct ct3a_rev_ops ct3a_rev_ops_proto1_2 = {
+	.te_fixed = CT3A_PAYLOAD(0xB9, 0x51, 0x51, 0x00, 0x00),
+	.te_changeable = CT3A_PAYLOAD(0xB9, 0x04, 0x51, 0x00, 0x00),
+	.fi_step_ns = CT3A_PAYLOAD(0xB0, 0x00, 0x85),
+	.fi_step_hs = CT3A_PAYLOAD(0xB0, 0x00, 0x83),
+	.manual_ns_1hz = 0x1E,
+	.manual_hs_30hz = 0x02,
+	.manual_hs_60hz = 0x01,
+};
 
-	return ctx->idle_data.panel_idle_enabled;
-}
+static const struct ct3a_rev_ops ct3a_rev_ops_evt1 = {
+	.te_fixed = CT3A_PAYLOAD(0xB9, 0x51),
+	.te_changeable = CT3A_PAYLOAD(0xB9, 0x04),
+	.fi_step_ns = CT3A_PAYLOAD(0xB0, 0x00, 0x85, 0xBD),
+	.fi_step_hs = CT3A_PAYLOAD(0xB0, 0x00, 0x83, 0xBD),
+	.manual_ns_1hz = 0x1E,
+	.manual_hs_30hz = 0x03,
+	.manual_hs_60hz = 0x02,
+};
 
-static u32 ct3a_get_min_idle_vrefresh(struct gs_panel *ctx,
-				     const struct gs_panel_mode *pmode)
+static void ct3a_add_payload(struct device *dev, const struct ct3a_payload *p)
 {
-	const int vrefresh = drm_mode_vrefresh(&pmode->mode);
-	int min_idle_vrefresh = ctx->min_vrefresh;
-
-	if ((min_idle_vrefresh < 0) || !is_auto_mode_allowed(ctx))
-		return 0;
-
-	if (min_idle_vrefresh <= 1)
-		min_idle_vrefresh = 1;
-	else if (min_idle_vrefresh <= 10)
-		min_idle_vrefresh = 10;
-	else if (min_idle_vrefresh <= 30)
-		min_idle_vrefresh = 30;
-	else
-		return 0;
-
-	if (min_idle_vrefresh >= vrefresh) {
-		dev_dbg(ctx->dev, "min idle vrefresh (%d) higher than target (%d)\n",
-				min_idle_vrefresh, vrefresh);
-		return 0;
-	}
-
-	dev_dbg(ctx->dev, "%s: min_idle_vrefresh %d\n", __func__, min_idle_vrefresh);
-
-	return min_idle_vrefresh;
+	if (p->len)
+		gs_dsi_dcs_write_buffer(to_mipi_dsi_device(dev), p->cmd, p->len, GS_DSI_MSG_QUEUE);
 }
 
 /**
@@ -279,6 +319,7 @@ static void ct3a_set_panel_feat(struct gs_panel *ctx,
 	const struct gs_panel_mode *pmode, u32 idle_vrefresh, bool enforce)
 {
 	struct ct3a_panel *spanel = to_spanel(ctx);
+	const struct ct3a_rev_ops *ops = spanel->rev_ops;
 	struct device *dev = ctx->dev;
 	unsigned long *feat = ctx->sw_status.feat;
 	u32 vrefresh = drm_mode_vrefresh(&pmode->mode);
@@ -336,10 +377,7 @@ static void ct3a_set_panel_feat(struct gs_panel *ctx,
 							0xE0, 0x00, 0x01);
 				GS_DCS_BUF_ADD_CMD(dev, 0xB9, 0x61);
 			} else {
-				if (ctx->panel_rev < PANEL_REV_EVT1)
-					GS_DCS_BUF_ADD_CMD(dev, 0xB9, 0x51, 0x51, 0x00, 0x00);
-				else
-					GS_DCS_BUF_ADD_CMD(dev, 0xB9, 0x51);
+				ct3a_add_payload(dev, &ops->te_fixed);
 
 				GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x00, 0x02, 0xB9);
 				/* Fixed TE */
@@ -352,13 +390,7 @@ static void ct3a_set_panel_feat(struct gs_panel *ctx,
 			ctx->hw_status.te.option = TEX_OPT_FIXED;
 		} else {
 			/* Changeable TE */
-			if (ctx->panel_rev == PANEL_REV_PROTO1)
-				GS_DCS_BUF_ADD_CMD(dev, 0xB9, 0x00, 0x51, 0x00, 0x00);
-			else if (ctx->panel_rev == PANEL_REV_PROTO1_1 ||
-					    ctx->panel_rev == PANEL_REV_PROTO1_2)
-				GS_DCS_BUF_ADD_CMD(dev, 0xB9, 0x04, 0x51, 0x00, 0x00);
-			else
-				GS_DCS_BUF_ADD_CMD(dev, 0xB9, 0x04);
+			ct3a_add_payload(dev, &ops->te_changeable);
 			ctx->hw_status.te.option = TEX_OPT_CHANGEABLE;
 		}
 	}
@@ -432,18 +464,9 @@ static void ct3a_set_panel_feat(struct gs_panel *ctx,
 		else
 			GS_DCS_BUF_ADD_CMD(dev, 0xBD, 0x00, 0x00, 0x02, 0x00);
 
-		if (ctx->panel_rev >= PANEL_REV_PROTO1_2) {
-			if (test_bit(FEAT_OP_NS, feat)) {
-				if (ctx->panel_rev == PANEL_REV_PROTO1_2)
-					GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x00, 0x85);
-				else
-					GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x00, 0x85, 0xBD);
-			} else {
-				if (ctx->panel_rev == PANEL_REV_PROTO1_2)
-					GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x00, 0x83);
-				else
-					GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x00, 0x83, 0xBD);
-			}
+		if (ops->fi_step_ns.len) {
+			ct3a_add_payload(dev, test_bit(FEAT_OP_NS, feat) ?
+					 &ops->fi_step_ns : &ops->fi_step_hs);
 			GS_DCS_BUF_ADD_CMD(dev, 0xBD, 0x00);
 		}
 	} else { /* manual */
@@ -460,10 +483,7 @@ static void ct3a_set_panel_feat(struct gs_panel *ctx,
 			GS_DCS_BUF_ADD_CMD(dev, 0xF2, 0x01);
 
 			if (vrefresh == 1) {
-				if (ctx->panel_rev >= PANEL_REV_PROTO1_2)
-					val = 0x1E;
-				else
-					val = 0x1D;
+				val = ops->manual_ns_1hz;
 			} else if (vrefresh == 10) {
 				val = 0x1C;
 			} else if (vrefresh == 30) {
@@ -484,15 +504,9 @@ static void ct3a_set_panel_feat(struct gs_panel *ctx,
 			} else if (vrefresh == 10) {
 				val = 0x05;
 			} else if (vrefresh == 30) {
-				if (ctx->panel_rev < PANEL_REV_EVT1)
-					val = 0x02;
-				else
-					val = 0x03;
+				val = ops->manual_hs_30hz;
 			} else if (vrefresh == 60) {
-				if (ctx->panel_rev < PANEL_REV_EVT1)
-					val = 0x01;
-				else
-					val = 0x02;
+				val = ops->manual_hs_60hz;
 			} else {
 				if (vrefresh != 120)
 					dev_warn(ctx->dev,
@@ -586,107 +600,42 @@ static void ct3a_change_frequency(struct gs_panel *ctx,
 	dev_dbg(ctx->dev, "%s: change to %uHz\n", __func__, vrefresh);
 }
 
-static void ct3a_panel_idle_notification(struct gs_panel *ctx,
-				u32 display_id, u32 vrefresh, u32 idle_te_vrefresh)
-{
-	char event_string[64];
-	char *envp[] = { event_string, NULL };
-	struct drm_device *dev = ctx->bridge.dev;
-
-	if (!dev) {
-		dev_warn(ctx->dev, "%s: drm_device is null\n", __func__);
-	} else {
-		snprintf(event_string, sizeof(event_string),
-			"PANEL_IDLE_ENTER=%u,%u,%u", display_id, vrefresh, idle_te_vrefresh);
-		kobject_uevent_env(&dev->primary->kdev->kobj, KOBJ_CHANGE, envp);
-	}
-}
-
 static void ct3a_wait_one_vblank(struct gs_panel *ctx)
 {
-	struct drm_crtc *crtc = NULL;
-
-	if (ctx->gs_connector->base.state)
-		crtc = ctx->gs_connector->base.state->crtc;
-
 	PANEL_ATRACE_BEGIN(__func__);
-	if (crtc) {
-		int ret = drm_crtc_vblank_get(crtc);
-
-		if (!ret) {
-			drm_crtc_wait_one_vblank(crtc);
-			drm_crtc_vblank_put(crtc);
-		} else {
-			usleep_range(8350, 8500);
-		}
-	} else {
-		usleep_range(8350, 8500);
-	}
+	ct3_wait_one_vblank(ctx, &to_spanel(ctx)->te);
 	PANEL_ATRACE_END(__func__);
 }
 
-static bool ct3a_set_self_refresh(struct gs_panel *ctx, bool enable)
+static u32 ct3a_get_min_idle_vrefresh(struct gs_panel *ctx, const struct gs_panel_mode *pmode)
 {
-	const struct gs_panel_mode *pmode = ctx->current_mode;
-	struct ct3a_panel *spanel = to_spanel(ctx);
-	u32 idle_vrefresh;
-
-	dev_dbg(ctx->dev, "%s: %d\n", __func__, enable);
-
-	if (unlikely(!pmode))
-		return false;
-
-	/* self refresh is not supported in lp mode since that always makes use of early exit */
-	if (pmode->gs_mode.is_lp_mode) {
-		/* set 1Hz while self refresh is active, otherwise clear it */
-		ctx->idle_data.panel_idle_vrefresh = enable ? 1 : 0;
-		notify_panel_mode_changed(ctx);
-		return false;
-	}
-
-	idle_vrefresh = ct3a_get_min_idle_vrefresh(ctx, pmode);
-
-	if (pmode->idle_mode != GIDLE_MODE_ON_SELF_REFRESH) {
-		/*
-		 * if idle mode is on inactivity, may need to update the target fps for auto mode,
-		 * or switch to manual mode if idle should be disabled (idle_vrefresh=0)
-		 */
-		if ((pmode->idle_mode == GIDLE_MODE_ON_INACTIVITY) &&
-			(spanel->auto_mode_vrefresh != idle_vrefresh)) {
-			ct3a_update_refresh_mode(ctx, pmode, idle_vrefresh);
-			return true;
-		}
-		return false;
-	}
-
-	if (!enable)
-		idle_vrefresh = 0;
-
-	/* if there's no change in idle state then skip cmds */
-	if (ctx->idle_data.panel_idle_vrefresh == idle_vrefresh)
-		return false;
+	return ct3_get_min_idle_vrefresh(ctx, pmode, NULL, 0);
+}
 
-	PANEL_ATRACE_BEGIN(__func__);
-	ct3a_update_refresh_mode(ctx, pmode, idle_vrefresh);
+static u32 ct3a_get_auto_mode_vrefresh(struct gs_panel *ctx)
+{
+	return to_spanel(ctx)->auto_mode_vrefresh;
+}
 
-	if (idle_vrefresh) {
-		const int vrefresh = drm_mode_vrefresh(&pmode->mode);
+static void ct3a_send_early_exit(struct gs_panel *ctx)
+{
+	struct device *dev = ctx->dev;
 
-		ct3a_panel_idle_notification(ctx, 0, vrefresh, 120);
-	} else if (ctx->idle_data.panel_need_handle_idle_exit) {
-		/*
-		 * after exit idle mode with fixed TE at non-120hz, TE may still keep at 120hz.
-		 * If any layer that already be assigned to DPU that can't be handled at 120hz,
-		 * panel_need_handle_idle_exit will be set then we need to wait one vblank to
-		 * avoid underrun issue.
-		 */
-		dev_dbg(ctx->dev, "wait one vblank after exit idle\n");
-		ct3a_wait_one_vblank(ctx);
-	}
+	GS_DCS_BUF_ADD_CMDLIST(dev, unlock_cmd_f0);
+	GS_DCS_BUF_ADD_CMDLIST(dev, ltps_update);
+	GS_DCS_BUF_ADD_CMDLIST_AND_FLUSH(dev, lock_cmd_f0);
+}
 
-	PANEL_ATRACE_END(__func__);
+static const struct ct3_vrr_funcs ct3a_vrr_funcs = {
+	.update_refresh_mode = ct3a_update_refresh_mode,
+	.get_min_idle_vrefresh = ct3a_get_min_idle_vrefresh,
+	.get_auto_mode_vrefresh = ct3a_get_auto_mode_vrefresh,
+	.send_early_exit = ct3a_send_early_exit,
+};
 
-	return true;
+static bool ct3a_set_self_refresh(struct gs_panel *ctx, bool enable)
+{
+	return ct3_set_self_refresh(ctx, &to_spanel(ctx)->vrr, enable);
 }
 
 static int ct3a_atomic_check(struct gs_panel *ctx, struct drm_atomic_state *state)
@@ -898,6 +847,8 @@ static int ct3a_set_brightness(struct gs_panel *ctx, u16 br)
 	u16 brightness;
 	struct ct3a_panel *spanel = to_spanel(ctx);
 
+	ct3_bl_publish_state(&spanel->bl_snapshot);
+
 	if (ctx->current_mode->gs_mode.is_lp_mode) {
 
 		/* don't stay at pixel-off state in AOD, or black screen is possibly seen */
@@ -993,6 +944,8 @@ static int ct3a_disable(struct drm_panel *panel)
 	if (ret)
 		return ret;
 
+	ct3_bl_publish(&to_spanel(ctx)->bl_snapshot, 0);
+
 	/* panel register state gets reset after disabling hardware */
 	bitmap_clear(ctx->hw_status.feat, 0, FEAT_MAX);
 	ctx->hw_status.vrefresh = 60;
@@ -1036,21 +989,8 @@ static void ct3a_update_idle_state(struct gs_panel *ctx)
 		return;
 	}
 
-	/* triggering early exit causes a switch to 120hz */
-	ctx->timestamps.last_mode_set_ts = ktime_get();
-
 	PANEL_ATRACE_BEGIN(__func__);
-
-	if (!ctx->idle_data.idle_delay_ms && spanel->force_changeable_te) {
-		dev_dbg(dev, "sending early exit out cmd\n");
-		GS_DCS_BUF_ADD_CMDLIST(dev, unlock_cmd_f0);
-		GS_DCS_BUF_ADD_CMDLIST(dev, ltps_update);
-		GS_DCS_BUF_ADD_CMDLIST_AND_FLUSH(dev, lock_cmd_f0);
-	} else {
-		/* turn off auto mode to prevent panel from lowering frequency too fast */
-		ct3a_update_refresh_mode(ctx, ctx->current_mode, 0);
-	}
-
+	ct3_early_exit(ctx, &spanel->vrr, spanel->force_changeable_te);
 	PANEL_ATRACE_END(__func__);
 }
 
@@ -1108,6 +1048,13 @@ static bool ct3a_is_mode_seamless(const struct gs_panel *ctx,
 	const struct drm_display_mode *c = &ctx->current_mode->mode;
 	const struct drm_display_mode *n = &pmode->mode;
 
+	/*
+	 * all modes share one DSC profile and DSI rate today, this only keeps a mode
+	 * added with its own profile from switching without the PPS being sent again
+	 */
+	if (ctx->current_mode->gs_mode.dsc.cfg != pmode->gs_mode.dsc.cfg)
+		return false;
+
 	/* seamless mode set can happen if active region resolution is same */
 	return (c->vdisplay == n->vdisplay) && (c->hdisplay == n->hdisplay);
 }
@@ -1125,6 +1072,8 @@ static void ct3a_debugfs_init(struct drm_panel *panel, struct dentry *root)
 	if (!panel_root)
 		return;
 
+	ct3_dsi_prof_debugfs_init(panel_root);
+
 	csroot = debugfs_lookup("cmdsets", panel_root);
 	if (!csroot) {
 		goto panel_out;
@@ -1200,6 +1149,8 @@ static int ct3a_read_default_voltage(struct gs_panel *ctx)
 	} else {
 		vlin[2] = 0x06; /* use vlin 7.7v as default */
 		dev_err(dev, "unable to read vlin\n");
+		ct3_log(ctx, CT3_LOG_READ_ERR, 0x48, ret);
+		ct3_log_dump("vlin read failed");
 	}
 	GS_DCS_BUF_ADD_CMDLIST_AND_FLUSH(dev, lock_cmd_f0);
 
@@ -1235,11 +1186,11 @@ static int ct3a_enable(struct drm_panel *panel)
 
 	PANEL_ATRACE_BEGIN(__func__);
 
-	gs_panel_reset_helper(ctx);
+	ct3_prewarm_reset(&to_spanel(ctx)->prewarm);
 
 	/* TODO: b/277158216, Use 0x9E for PPS setting */
 	/* DSC related configuration */
-	gs_dcs_write_dsc_config(dev, &pps_config);
+	gs_dcs_write_dsc_config(dev, pmode->gs_mode.dsc.cfg);
 	GS_DCS_WRITE_CMD(dev, 0x9D, 0x01); /* DSC Enable */
 
 	if(ctx->panel_rev < PANEL_REV_EVT1) {
@@ -1267,6 +1218,7 @@ static int ct3a_enable(struct drm_panel *panel)
 	GS_DCS_WRITE_CMD(dev, MIPI_DCS_SET_DISPLAY_ON);
 
 	ct3a_set_default_voltage(ctx, true);
+	ct3_bl_publish_state(&to_spanel(ctx)->bl_snapshot);
 	dev_info(ctx->dev, "%s -\n", __func__);
 
 	PANEL_ATRACE_END(__func__);
@@ -1274,31 +1226,6 @@ static int ct3a_enable(struct drm_panel *panel)
 	return 0;
 }
 
-static int spanel_get_brightness(struct thermal_zone_device *tzd, int *temp)
-{
-	struct ct3a_panel *spanel;
-
-	if (tzd == NULL)
-		return -EINVAL;
-
-	spanel = tzd->devdata;
-
-	if (spanel && spanel->base.bl) {
-		mutex_lock(&spanel->base.bl_state_lock);
-		*temp = (spanel->base.bl->props.state & BL_STATE_STANDBY) ?
-					0 : spanel->base.bl->props.brightness;
-		mutex_unlock(&spanel->base.bl_state_lock);
-	} else {
-		return -EINVAL;
-	}
-
-	return 0;
-}
-
-static struct thermal_zone_device_ops spanel_tzd_ops = {
-	.get_temp = spanel_get_brightness,
-};
-
 static void ct3a_panel_init(struct gs_panel *ctx)
 {
 	const struct gs_panel_mode *pmode = ctx->current_mode;
@@ -1324,32 +1251,57 @@ static int ct3a_panel_probe(struct mipi_dsi_device *dsi)
 
 	ctx = &spanel->base;
 
-	ctx->thermal = devm_kzalloc(&dsi->dev, sizeof(*ctx->thermal), GFP_KERNEL);
-	if (!ctx->thermal) {
-		devm_kfree(&dsi->dev, spanel);
-		return -ENOMEM;
-	}
-
+	/* until panel_config() knows the revision */
+	spanel->rev_ops = &ct3a_rev_ops_evt1;
 	spanel->base.op_hz = 120;
 	spanel->is_pixel_off = false;
 	ctx->hw_status.vrefresh = 60;
 	ctx->hw_status.te.rate_hz = 60;
 	clear_bit(FEAT_ZA, ctx->hw_status.feat);
+	ct3_te_init(&dsi->dev, &spanel->te);
+	ret = ct3_bl_snapshot_init(&dsi->dev, &spanel->bl_snapshot, ctx);
+	if (ret)
+		return ret;
+	spanel->vrr.funcs = &ct3a_vrr_funcs;
+	spanel->vrr.te = &spanel->te;
 
-	ctx->thermal->tz = thermal_zone_device_register("inner_brightness",
-				0, 0, spanel, &spanel_tzd_ops, NULL, 0, 0);
-	if (IS_ERR(ctx->thermal->tz))
-		dev_err(ctx->dev, "failed to register inner"
-			" display thermal zone: %ld", PTR_ERR(ctx->thermal->tz));
-
-	ret = thermal_zone_device_enable(ctx->thermal->tz);
-	if (ret) {
-		dev_err(ctx->dev, "failed to enable inner"
-					" display thermal zone ret=%d", ret);
-		thermal_zone_device_unregister(ctx->thermal->tz);
-	}
+	ret = ct3_bl_thermal_init(&dsi->dev, &spanel->bl_snapshot, "inner_brightness");
+	if (ret)
+		return ret;
+	ct3_prewarm_init(ctx, &spanel->prewarm);
+
+	ret = gs_dsi_panel_common_init(dsi, ctx);
+	if (ret)
+		return ret;
+
+	ct3_prewarm_register(&spanel->prewarm);
+
+	return 0;
+}
 
-	return gs_dsi_panel_common_init(dsi, ctx);
+static void ct3a_panel_remove(struct mipi_dsi_device *dsi)
+{
+	struct gs_panel *ctx = mipi_dsi_get_drvdata(dsi);
+
+	/* stop powering the panel before the common remove tears it down */
+	ct3_prewarm_remove(&to_spanel(ctx)->prewarm);
+	ct3_bl_snapshot_remove(&to_spanel(ctx)->bl_snapshot);
+
+	gs_dsi_panel_common_remove(dsi);
+}
+
+static int ct3a_prepare(struct drm_panel *panel)
+{
+	struct gs_panel *ctx = container_of(panel, struct gs_panel, base);
+
+	return ct3_prewarm_prepare(&to_spanel(ctx)->prewarm);
+}
+
+static int ct3a_unprepare(struct drm_panel *panel)
+{
+	struct gs_panel *ctx = container_of(panel, struct gs_panel, base);
+
+	return ct3_prewarm_unprepare(&to_spanel(ctx)->prewarm);
 }
 
 static const struct gs_display_underrun_param underrun_param = {
@@ -1546,8 +1498,8 @@ static const struct gs_panel_mode_array ct3a_lp_mode = {
 
 static const struct drm_panel_funcs ct3a_drm_funcs = {
 	.disable = ct3a_disable,
-	.unprepare = gs_panel_unprepare,
-	.prepare = gs_panel_prepare,
+	.unprepare = ct3a_unprepare,
+	.prepare = ct3a_prepare,
 	.enable = ct3a_enable,
 	.get_modes = gs_panel_get_modes,
 	.debugfs_init = ct3a_debugfs_init,
@@ -1633,6 +1585,21 @@ static struct gs_panel_brightness_desc ct3a_brightness_desc = {
 
 static int ct3a_panel_config(struct gs_panel *ctx)
 {
+	struct ct3a_panel *spanel = to_spanel(ctx);
+
+	/*
+	 * resolve the revision dependent feature settings once panel_rev is known, proto
+	 * builds without a table of their own use the one of the build before them
+	 */
+	if (ctx->panel_rev < PANEL_REV_PROTO1_1)
+		spanel->rev_ops = &ct3a_rev_ops_proto1;
+	else if (ctx->panel_rev < PANEL_REV_PROTO1_2)
+		spanel->rev_ops = &ct3a_rev_ops_proto1_1;
+	else if (ctx->panel_rev < PANEL_REV_EVT1)
+		spanel->rev_ops = &ct3a_rev_ops_proto1_2;
+	else
+		spanel->rev_ops = &ct3a_rev_ops_evt1;
+
 	/* b/300383405 Currently, we can't support multiple
 	 *  displays in `display_layout_configuration.xml`.
 	 */
@@ -1701,7 +1668,7 @@ static const struct of_device_id gs_panel_of_match[] = {
 
 static struct mipi_dsi_driver gs_panel_driver = {
 	.probe = ct3a_panel_probe,
-	.remove = gs_dsi_panel_common_remove,
+	.remove = ct3a_panel_remove,
 	.driver = {
 		.name = "panel-gs-ct3a",
 		.of_match_table = gs_panel_of_match,
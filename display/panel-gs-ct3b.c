@@ -1,12 +1,15 @@
 /* SPDX-License-Identifier: MIT */
 
+#include <drm/drm_damage_helper.h>
 #include <drm/drm_vblank.h>
+#include <linux/completion.h>
 #include <linux/debugfs.h>
 #include <linux/delay.h>
+#include <linux/input.h>
+#include <linux/kthread.h>
 #include <linux/module.h>
 #include <linux/of_platform.h>
-#include <linux/swab.h>
-#include <linux/thermal.h>
+#include <linux/seq_file.h>
 #include <video/mipi_display.h>
 
 #include "trace/panel_trace.h"
@@ -15,25 +18,35 @@
 #include "gs_panel/gs_panel.h"
 #include "gs_panel/gs_panel_funcs_defaults.h"
 
+#include "panel-gs-ct3.h"
+
 #define CT3B_DDIC_ID_LEN 8
-#define CT3B_DIMMING_FRAME 32
+#define CT3B_TOUCH_BOOST_INTERVAL_MS 100
+#define CT3B_TOUCH_BOOST_TIMEOUT_MS 200
+#define CT3B_AOD_HYSTERESIS 16
+#define CT3B_AOD_DWELL_MS 2000
+/* DSC slice height, a partial update window has to cover whole slice rows */
+#define CT3B_DSC_SLICE_HEIGHT 12
+/* dirty windows taller than this share of the screen count as full frames */
+#define CT3B_ROI_MAX_PERCENT 50
+/* checked commits whose window is kept until their commit is done */
+#define CT3B_ROI_PENDING 4
 #define EDGE_COMPENSATION_SIZE 13
 
 #define PROJECT "CT3B"
 
 /**
- * enum ct3b_dbv_range
- * @DBV_INIT: initialize
+ * enum ct3b_dbv_range - index of the DBV zones in ct3b_dbv_zones
  * @DBV_RANGE1: 2nits to 24nits
- * @DBV_RANGE2: 25nits
+ * @DBV_RANGE2: 25nits, tuned at 0x027D and used two codes either side of it
  * @DBV_RANGE3: 26nits to 120nits
  * @DBV_RANGE4: 121nits to 400nits
  * @DBV_RANGE5: 401nits to 1000nits
  * @DBV_HBM: hbm mode
  * @DBV_HBM2: hbm2 mode
+ * @DBV_RANGE_MAX: number of zones
  */
 enum ct3b_dbv_range {
-	DBV_INIT,
 	DBV_RANGE1,
 	DBV_RANGE2,
 	DBV_RANGE3,
@@ -41,6 +54,246 @@ enum ct3b_dbv_range {
 	DBV_RANGE5,
 	DBV_HBM,
 	DBV_HBM2,
+	DBV_RANGE_MAX,
+};
+
+/* ECC configuration indexes used in ct3b_dbv_zones */
+#define CT3B_ECC_2NITS 0
+#define CT3B_ECC_DEFAULT 1
+
+#define CT3B_DBV_ZONE(dbv, gamma, ecc, ...) {	\
+	.min_dbv = dbv,				\
+	.cfg = {				\
+		[CT3_ZONE_REG_GAMMA] = gamma,	\
+		[CT3_ZONE_REG_ECC] = ecc,	\
+	},					\
+	__VA_ARGS__				\
+}
+
+/* zones for PANEL_REV_EVT1_1 and later, gamma config indexes ct3b_gamma_configs */
+static const struct ct3_dbv_zone ct3b_dbv_zones[DBV_RANGE_MAX] = {
+	[DBV_RANGE1] = CT3B_DBV_ZONE(0x0001, 0, CT3B_ECC_2NITS),
+	[DBV_RANGE2] = CT3B_DBV_ZONE(0x027B, 1, CT3B_ECC_DEFAULT),
+	[DBV_RANGE3] = CT3B_DBV_ZONE(0x0280, 2, CT3B_ECC_DEFAULT),
+	[DBV_RANGE4] = CT3B_DBV_ZONE(0x069D, 3, CT3B_ECC_DEFAULT),
+	[DBV_RANGE5] = CT3B_DBV_ZONE(0x0AD7, 4, CT3B_ECC_DEFAULT),
+	[DBV_HBM] = CT3B_DBV_ZONE(0x0DA3, 5, CT3B_ECC_DEFAULT),
+	[DBV_HBM2] = CT3B_DBV_ZONE(0x0F06, 5, CT3B_ECC_DEFAULT),
+};
+
+#define CT3B_DBV_MAX 0x0FFF
+
+static const u8 ct3b_gamma_configs[][2] = {
+	{ 0x40, 0xFF },
+	{ 0x2C, 0xD4 },
+	{ 0x1C, 0x85 },
+	{ 0x13, 0x5C },
+	{ 0x0D, 0x40 },
+	{ 0x0B, 0x36 },
+};
+
+/**
+ * struct ct3b_elvss_payload - prebuilt ELVSS rows sent around HBM2 transitions
+ *
+ * Each member is one complete DCS packet. The 0xB5 rows at offsets 0x2D and 0x44
+ * are adjacent in the register map, so they are packed into a single write.
+ */
+struct ct3b_elvss_payload {
+	/** @ofs_06: offset of the first row */
+	u8 ofs_06[2];
+	/** @b5_06: 0xB5 row at offset 0x06 */
+	u8 b5_06[5];
+	/** @ofs_11: offset of the second row */
+	u8 ofs_11[2];
+	/** @b5_11: 0xB5 row at offset 0x11 */
+	u8 b5_11[6];
+	/** @ofs_2d: offset of the packed third and fourth rows */
+	u8 ofs_2d[2];
+	/** @b5_2d: 0xB5 rows at offsets 0x2D and 0x44 */
+	u8 b5_2d[47];
+};
+
+/**
+ * struct ct3b_irc_payload - prebuilt IRC setting of one panel revision
+ */
+struct ct3b_irc_payload {
+	/** @has_ba_b0: the revision has the 0xBA row at offset 0xB0 */
+	bool has_ba_b0;
+	/** @ofs_b0: offset of the 0xBA row */
+	u8 ofs_b0[2];
+	/** @ba_b0: 0xBA row at offset 0xB0 */
+	u8 ba_b0[5];
+	/** @ofs_03: offset of the 0xC0 setting */
+	u8 ofs_03[2];
+	/** @c0_03: 0xC0 setting at offset 0x03 */
+	u8 c0_03[2];
+};
+
+/**
+ * enum ct3b_fi_rate - frame insertion rates below 120Hz
+ */
+enum ct3b_fi_rate {
+	CT3B_FI_60HZ,
+	CT3B_FI_30HZ,
+	CT3B_FI_10HZ,
+	CT3B_FI_1HZ,
+	CT3B_FI_MAX,
+};
+
+/**
+ * struct ct3b_rev_ops - register values that differ between panel revisions
+ */
+struct ct3b_rev_ops {
+	/** @fi: 0x6D frame insertion setting, indexed by enum ct3b_fi_rate */
+	u8 fi[CT3B_FI_MAX];
+	/** @lp_early_exit: early exit and AOD idle TE are set up around LP mode */
+	bool lp_early_exit;
+	/** @irc_off: IRC off, sent while in HBM with IRC off */
+	const struct ct3b_irc_payload *irc_off;
+	/** @irc_on: IRC on */
+	const struct ct3b_irc_payload *irc_on;
+};
+
+/**
+ * struct ct3b_roi_pending - dirty window of a checked commit
+ */
+struct ct3b_roi_pending {
+	/** @key: new CRTC state of the commit, NULL once accounted */
+	const struct drm_crtc_state *key;
+	/** @full: the commit would need a full frame */
+	bool full;
+	/** @win: dirty window, in CRTC coordinates */
+	struct drm_rect win;
+};
+
+/**
+ * struct ct3b_roi - dirty window statistics, debug only
+ *
+ * Measures how much a partial update could save; the panel still gets full frames,
+ * no column/page address (0x2A/0x2B) is programmed. The window always spans the
+ * full width: both DSC slices sit side by side, so only whole slice rows could be
+ * skipped. Windows are computed in atomic_check, which also runs for TEST_ONLY
+ * commits and for the next frame while one is in flight, so each one is keyed by
+ * its CRTC state and only counted when that state is the one committed.
+ */
+struct ct3b_roi {
+	/** @enabled: compute the dirty window of each commit */
+	bool enabled;
+	/** @max_percent: taller windows count as a full frame */
+	u32 max_percent;
+	/** @lock: protects @pending against commit_done */
+	spinlock_t lock;
+	/** @pending: windows of the last checked commits */
+	struct ct3b_roi_pending pending[CT3B_ROI_PENDING];
+	/** @next: slot of @pending the next checked commit goes to */
+	unsigned int next;
+	/** @frames: number of commits looked at */
+	u32 frames;
+	/** @partial: number of commits that would fit a partial update window */
+	u32 partial;
+	/** @rows: total rows of the partial update windows */
+	u64 rows;
+	/** @last: window of the last commit, in CRTC coordinates */
+	struct drm_rect last;
+};
+
+/**
+ * struct ct3b_aod_bl - AOD brightness level selection
+ *
+ * Brightness has to move @hysteresis past a level edge before the level changes,
+ * so ALS noise around an edge doesn't keep resending the LP commands. Changes to
+ * an adjacent level are held back while the panel sits in 1Hz self refresh or
+ * within @dwell_ms of the last change, and go out with the next self refresh exit,
+ * brightness update or once @dwell_ms has passed instead.
+ */
+struct ct3b_aod_bl {
+	/** @level: current binned LP level, negative if unknown */
+	int level;
+	/** @pending: a level change has been held back */
+	bool pending;
+	/** @pending_br: brightness of the held back change */
+	u16 pending_br;
+	/** @hysteresis: brightness margin past a level edge */
+	u32 hysteresis;
+	/** @dwell_ms: minimum time between level changes */
+	u32 dwell_ms;
+	/** @last_change: time of the last level change */
+	ktime_t last_change;
+	/** @changes: number of level changes sent */
+	u32 changes;
+	/** @deferred: number of level changes held back */
+	u32 deferred;
+};
+
+/**
+ * struct ct3b_cadence - commit cadence predictor used for early exit decisions
+ */
+struct ct3b_cadence {
+	/** @enabled: adapt threshold and idle target to the commit cadence */
+	bool enabled;
+	/** @avg_us: moving average of the commit interval */
+	u32 avg_us;
+	/** @dev_us: moving average of the deviation from @avg_us */
+	u32 dev_us;
+	/** @threshold_us: commit interval above which early exit is triggered */
+	u32 threshold_us;
+	/** @idle_hz: lowest auto mode rate that keeps up with the cadence, 0 if unsteady */
+	u32 idle_hz;
+	/** @early_exits: number of commits which triggered early exit */
+	u32 early_exits;
+	/** @skipped: number of commits which didn't need early exit */
+	u32 skipped;
+};
+
+#define CT3B_STATS_MAX_STATES 16
+#define CT3B_STATS_OFF (-1)
+
+#define CT3B_STATS_AUTO BIT(0)
+#define CT3B_STATS_EARLY_EXIT BIT(1)
+#define CT3B_STATS_MANUAL_FI BIT(2)
+#define CT3B_STATS_LP BIT(3)
+
+/**
+ * struct ct3b_rr_state - refresh rate state as last committed to the panel
+ */
+struct ct3b_rr_state {
+	/** @vrefresh: panel refresh rate */
+	u16 vrefresh;
+	/** @idle_vrefresh: auto mode target rate, 0 if auto mode is off */
+	u16 idle_vrefresh;
+	/** @te_hz: TE rate */
+	u16 te_hz;
+	/** @flags: CT3B_STATS_* flags */
+	u16 flags;
+};
+
+/**
+ * struct ct3b_rr_stats - refresh rate residency and transition statistics
+ */
+struct ct3b_rr_stats {
+	/** @lock: protects all of the below */
+	spinlock_t lock;
+	/** @cur: index of the current state, CT3B_STATS_OFF while the panel is off */
+	int cur;
+	/** @since: time the current state was entered */
+	ktime_t since;
+	/** @reset_ts: time the statistics were last reset */
+	ktime_t reset_ts;
+	/** @num_states: number of valid entries in @states */
+	unsigned int num_states;
+	/** @dropped: transitions into states that didn't fit in @states */
+	u32 dropped;
+	/** @states: per state residency and cost of entering the state */
+	struct {
+		struct ct3b_rr_state key;
+		u64 time_ns;
+		u32 entries;
+		u32 tx_packets;
+		u64 tx_bytes;
+		u64 cost_ns;
+	} states[CT3B_STATS_MAX_STATES];
+	/** @transitions: number of transitions between states, [from][to] */
+	u32 transitions[CT3B_STATS_MAX_STATES][CT3B_STATS_MAX_STATES];
 };
 
 /**
@@ -56,9 +309,11 @@ struct ct3b_panel {
 	bool force_changeable_te;
 	/** @force_changeable_te2: force changeable TE2 for monitoring refresh rate */
 	bool force_changeable_te2;
-	/** @dbv_range: indicates current dbv range  */
-	enum ct3b_dbv_range dbv_range;
-	/** @edge_compensation: compensation default value **/
+	/** @dbv_range: index of the current dbv zone, CT3_DBV_ZONE_NONE if unknown */
+	int dbv_range;
+	/** @dbv_zones: dbv zones of the current panel revision */
+	struct ct3_dbv_zone_table dbv_zones;
+	/** @edge_compensation: compensation default value, read once per boot **/
 	struct edge_compensation {
 		bool is_support;
 		u8 left_default[EDGE_COMPENSATION_SIZE];
@@ -66,15 +321,133 @@ struct ct3b_panel {
 		u8 top_default[EDGE_COMPENSATION_SIZE];
 		u8 bottom_default[EDGE_COMPENSATION_SIZE];
 	}edge_comp;
+	/** @ddic_id_cached: DDIC id has been read into panel_id */
+	bool ddic_id_cached;
+	/** @probe_work: probe steps that aren't needed for the first frame */
+	struct work_struct probe_work;
+	/** @probe_done: completed once @probe_work has run */
+	struct completion probe_done;
 
 	/** @needs_display_on: if display_on command needs to send after flip done */
 	bool needs_display_on;
 	/** @needs_aod_idle: if AoD idle command needs to send after commit done */
 	bool needs_aod_idle;
+	/** @shadow: cached TE and frame insertion registers */
+	struct ct3_shadow shadow;
+	/** @te: TE interrupt used to wait for the next frame */
+	struct ct3_te te;
+	/** @te_sync: TE phase reference for the outer display */
+	struct ct3_te_sync te_sync;
+	/** @vrr: shared VRR/idle state machine */
+	struct ct3_vrr vrr;
+	/** @bl_snapshot: brightness read by the thermal zone */
+	struct ct3_bl_snapshot bl_snapshot;
+	/** @dimming: brightness ramp length and end of the last ramp */
+	struct ct3_dimming dimming;
+	/** @dimming_work: re-evaluates auto mode once a brightness ramp has finished */
+	struct delayed_work dimming_work;
+	/** @init_seq: init commands packed for the panel revision */
+	struct ct3_cmd_seq init_seq;
+	/** @cadence: commit cadence predictor */
+	struct ct3b_cadence cadence;
+	/** @aod: AOD brightness level selection */
+	struct ct3b_aod_bl aod;
+	/** @aod_work: sends a held back AOD level change once the dwell time has passed */
+	struct delayed_work aod_work;
+	/** @roi: dirty window statistics, debug only */
+	struct ct3b_roi roi;
+	/** @stats: refresh rate residency statistics */
+	struct ct3b_rr_stats stats;
+
+	/** @enable_worker: runs the enable stages that don't gate scanout */
+	struct kthread_worker *enable_worker;
+	/** @enable_work: deferred feature and frequency setup after enable */
+	struct kthread_work enable_work;
+	/** @enable_pmode: mode that the deferred enable stage is set up for */
+	const struct gs_panel_mode *enable_pmode;
+	/** @enable_pending: deferred enable stage queued and not claimed yet */
+	bool enable_pending;
+	/** @enable_task: task running the deferred enable stage, NULL if none */
+	struct task_struct *enable_task;
+	/** @enable_done: completed once the claimed deferred enable stage has run */
+	struct completion enable_done;
+
+	/** @prewarm: hall sensor driven pre-warm while the device unfolds */
+	struct ct3_prewarm prewarm;
+
+	/** @touch_boost: leaves panel idle on touch down, ahead of the first frame */
+	struct {
+		/** @touch_boost.enabled: boost on touch down */
+		bool enabled;
+		/** @touch_boost.registered: @touch_boost.handler is registered */
+		bool registered;
+		/** @touch_boost.np: touch controller of this panel, others are ignored */
+		struct device_node *np;
+		/** @touch_boost.interval_ms: minimum time between two boosts */
+		u32 interval_ms;
+		/** @touch_boost.timeout_ms: time to wait for a frame before going idle again */
+		u32 timeout_ms;
+		/** @touch_boost.last: time of the last boost, in ns */
+		atomic64_t last;
+		/** @touch_boost.boosts: number of boosts sent */
+		u32 boosts;
+		/** @touch_boost.expired: boosts that timed out without a frame */
+		u32 expired;
+		/** @touch_boost.work: sends the boost outside of input event context */
+		struct work_struct work;
+		/** @touch_boost.timeout_work: restores auto mode if no frame followed */
+		struct delayed_work timeout_work;
+		/** @touch_boost.handler: listens for touch down events */
+		struct input_handler handler;
+	} touch_boost;
+
+	/** @elvss_hbm2: ELVSS payload before entering HBM2, NULL if not needed */
+	const struct ct3b_elvss_payload *elvss_hbm2;
+	/** @elvss_normal: ELVSS payload after exiting HBM2, NULL if not needed */
+	const struct ct3b_elvss_payload *elvss_normal;
+	/** @rev_ops: revision specific register values, resolved once panel_rev is known */
+	const struct ct3b_rev_ops *rev_ops;
 };
 
 #define to_spanel(ctx) container_of(ctx, struct ct3b_panel, base)
 
+static void ct3b_enable_setup(struct gs_panel *ctx, const struct gs_panel_mode *pmode);
+
+/* run the deferred enable stage claimed through @enable_pending */
+static void ct3b_enable_run(struct ct3b_panel *spanel)
+{
+	WRITE_ONCE(spanel->enable_task, current);
+	ct3b_enable_setup(&spanel->base, spanel->enable_pmode);
+	WRITE_ONCE(spanel->enable_task, NULL);
+	complete_all(&spanel->enable_done);
+}
+
+/**
+ * ct3b_enable_sync - make sure the deferred enable stage has completed
+ * @ctx: gs_panel struct
+ *
+ * Must be called before sending any command that may follow enable, so that
+ * the deferred setup never interleaves with other DSI traffic, and before
+ * touching sw_status, hw_status or idle_data. The enable worker runs the stage
+ * under mode_lock, but most callers of this already hold mode_lock, so rather
+ * than waiting for the worker, a stage that it hasn't claimed yet is run by the
+ * caller. A stage claimed by the worker is waited for, which can only happen
+ * for callers that don't hold mode_lock. Calls made from within the stage
+ * itself, e.g. through the update_te2 hook, return right away.
+ */
+static void ct3b_enable_sync(struct gs_panel *ctx)
+{
+	struct ct3b_panel *spanel = to_spanel(ctx);
+
+	if (!spanel->enable_worker || READ_ONCE(spanel->enable_task) == current)
+		return;
+
+	if (xchg(&spanel->enable_pending, false))
+		ct3b_enable_run(spanel);
+	else
+		wait_for_completion(&spanel->enable_done);
+}
+
 static const struct gs_dsi_cmd ct3b_lp_night_cmds[] = {
 	/* 2 nit */
 	GS_DSI_CMD(0x6F, 0x04),
@@ -442,8 +815,106 @@ static const struct gs_dsi_cmd ct3b_init_cmds[] = {
 };
 static DEFINE_GS_CMDSET(ct3b_init);
 
+static const struct ct3b_elvss_payload ct3b_elvss_hbm2 = {
+	.ofs_06 = { 0x6F, 0x06 },
+	.b5_06 = { 0xB5, 0x7F, 0x00, 0x5C, 0x67 },
+	.ofs_11 = { 0x6F, 0x11 },
+	.b5_11 = { 0xB5, 0x5C, 0x5C, 0x5C, 0x5C, 0x5C },
+	.ofs_2d = { 0x6F, 0x2D },
+	.b5_2d = { 0xB5,
+		/* offset 0x2D */
+		0x29, 0x29, 0x29, 0x29, 0x29, 0x29, 0x29, 0x29, 0x29, 0x29, 0x29, 0x29,
+		0x22, 0x22, 0x1D, 0x1D, 0x13, 0x13, 0x05, 0x05, 0x01, 0x01, 0x01,
+		/* offset 0x44 */
+		0x29, 0x29, 0x29, 0x29, 0x29, 0x29, 0x29, 0x29, 0x29, 0x29, 0x29, 0x29,
+		0x22, 0x22, 0x1D, 0x1D, 0x13, 0x13, 0x05, 0x05, 0x01, 0x01, 0x01 },
+};
+
+static const struct ct3b_elvss_payload ct3b_elvss_normal = {
+	.ofs_06 = { 0x6F, 0x06 },
+	.b5_06 = { 0xB5, 0x7F, 0x00, 0x60, 0x67 },
+	.ofs_11 = { 0x6F, 0x11 },
+	.b5_11 = { 0xB5, 0x60, 0x60, 0x60, 0x60, 0x60 },
+	.ofs_2d = { 0x6F, 0x2D },
+	.b5_2d = { 0xB5,
+		/* offset 0x2D */
+		0x25, 0x25, 0x25, 0x25, 0x25, 0x25, 0x25, 0x25, 0x25, 0x25, 0x25, 0x25,
+		0x1E, 0x1E, 0x19, 0x19, 0x0F, 0x0F, 0x01, 0x01, 0x01, 0x01, 0x01,
+		/* offset 0x44 */
+		0x25, 0x25, 0x25, 0x25, 0x25, 0x25, 0x25, 0x25, 0x25, 0x25, 0x25, 0x25,
+		0x1E, 0x1E, 0x19, 0x19, 0x0F, 0x0F, 0x01, 0x01, 0x01, 0x01, 0x01 },
+};
+
+static void ct3b_add_elvss_payload(struct device *dev, const struct ct3b_elvss_payload *p)
+{
+	GS_DCS_BUF_ADD_CMDLIST(dev, p->ofs_06);
+	GS_DCS_BUF_ADD_CMDLIST(dev, p->b5_06);
+	GS_DCS_BUF_ADD_CMDLIST(dev, p->ofs_11);
+	GS_DCS_BUF_ADD_CMDLIST(dev, p->b5_11);
+	GS_DCS_BUF_ADD_CMDLIST(dev, p->ofs_2d);
+	GS_DCS_BUF_ADD_CMDLIST(dev, p->b5_2d);
+}
+
+static const struct ct3b_irc_payload ct3b_irc_off_evt = {
+	.ofs_03 = { 0x6F, 0x03 },
+	.c0_03 = { 0xC0, 0x32 },
+};
+
+static const struct ct3b_irc_payload ct3b_irc_on_evt = {
+	.ofs_03 = { 0x6F, 0x03 },
+	.c0_03 = { 0xC0, 0x30 },
+};
+
+static const struct ct3b_irc_payload ct3b_irc_off_dvt = {
+	.has_ba_b0 = true,
+	.ofs_b0 = { 0x6F, 0xB0 },
+	.ba_b0 = { 0xBA, 0x22, 0x22, 0x32, 0x33 },
+	.ofs_03 = { 0x6F, 0x03 },
+	.c0_03 = { 0xC0, 0x23 },
+};
+
+static const struct ct3b_irc_payload ct3b_irc_on_dvt = {
+	.has_ba_b0 = true,
+	.ofs_b0 = { 0x6F, 0xB0 },
+	.ba_b0 = { 0xBA, 0x00, 0x00, 0x10, 0x11 },
+	.ofs_03 = { 0x6F, 0x03 },
+	.c0_03 = { 0xC0, 0x21 },
+};
+
+static const struct ct3b_rev_ops ct3b_rev_ops_evt1 = {
+	.fi = { 0x00, 0x01, 0x02, 0x03 },
+	.irc_off = &ct3b_irc_off_evt,
+	.irc_on = &ct3b_irc_on_evt,
+};
+
+static const struct ct3b_rev_ops ct3b_rev_ops_evt1_1 = {
+	.fi = { 0x01, 0x02, 0x03, 0x04 },
+	.lp_early_exit = true,
+	.irc_off = &ct3b_irc_off_evt,
+	.irc_on = &ct3b_irc_on_evt,
+};
+
+static const struct ct3b_rev_ops ct3b_rev_ops_dvt1 = {
+	.fi = { 0x01, 0x02, 0x03, 0x04 },
+	.lp_early_exit = true,
+	.irc_off = &ct3b_irc_off_dvt,
+	.irc_on = &ct3b_irc_on_dvt,
+};
+
+/* IRC payloads end the transaction */
+static void ct3b_add_irc_payload(struct device *dev, const struct ct3b_irc_payload *p)
+{
+	if (p->has_ba_b0) {
+		GS_DCS_BUF_ADD_CMDLIST(dev, p->ofs_b0);
+		GS_DCS_BUF_ADD_CMDLIST(dev, p->ba_b0);
+	}
+	GS_DCS_BUF_ADD_CMDLIST(dev, p->ofs_03);
+	GS_DCS_BUF_ADD_CMDLIST_AND_FLUSH(dev, p->c0_03);
+}
+
 static void ct3b_update_irc(struct gs_panel *ctx, const enum gs_hbm_mode hbm_mode)
 {
+	struct ct3b_panel *spanel = to_spanel(ctx);
 	const u16 br = gs_panel_get_brightness(ctx);
 	struct device *dev = ctx->dev;
 
@@ -453,37 +924,16 @@ static void ct3b_update_irc(struct gs_panel *ctx, const enum gs_hbm_mode hbm_mod
 			/* ACD level.1 */
 			GS_DCS_BUF_ADD_CMD(dev, 0x55, 0x04);
 			/* Update the ELVSS before entry HBM2 */
-			if (ctx->panel_rev > PANEL_REV_EVT1_1) {
+			if (spanel->elvss_hbm2) {
 				GS_DCS_BUF_ADD_CMD(dev, 0xF0, 0x55, 0xAA, 0x52, 0x08, 0x00);
-				GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x06);
-				GS_DCS_BUF_ADD_CMD(dev, 0xB5, 0x7F, 0x00, 0x5C, 0x67);
-				GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x11);
-				GS_DCS_BUF_ADD_CMD(dev, 0xB5, 0x5C, 0x5C, 0x5C, 0x5C, 0x5C);
-				GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x2D);
-				GS_DCS_BUF_ADD_CMD(dev, 0xB5, 0x29, 0x29, 0x29, 0x29, 0x29, 0x29,
-							0x29, 0x29, 0x29, 0x29, 0x29, 0x29, 0x22,
-							0x22, 0x1D, 0x1D, 0x13, 0x13, 0x05, 0x05,
-							0x01, 0x01, 0x01);
-				GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x44);
-				GS_DCS_BUF_ADD_CMD(dev, 0xB5, 0x29, 0x29, 0x29, 0x29, 0x29, 0x29,
-							0x29, 0x29, 0x29, 0x29, 0x29, 0x29, 0x22,
-							0x22, 0x1D, 0x1D, 0x13, 0x13, 0x05, 0x05,
-							0x01, 0x01, 0x01);
+				ct3b_add_elvss_payload(dev, spanel->elvss_hbm2);
 			}
 		}
 
 		GS_DCS_BUF_ADD_CMD(dev, 0x5F, 0x01);
 		GS_DCS_BUF_ADD_CMD(dev, 0x26, 0x02);
 		GS_DCS_BUF_ADD_CMD(dev, 0xF0, 0x55, 0xAA, 0x52, 0x08, 0x00);
-		if (ctx->panel_rev < PANEL_REV_DVT1) {
-			GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x03);
-			GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0xC0, 0x32);
-		} else {
-			GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0xB0);
-			GS_DCS_BUF_ADD_CMD(dev, 0xBA, 0x22, 0x22, 0x32, 0x33);
-			GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x03);
-			GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0xC0, 0x23);
-		}
+		ct3b_add_irc_payload(dev, spanel->rev_ops->irc_off);
 	} else {
 		const u8 val1 = br >> 8;
 		const u8 val2 = br & 0xff;
@@ -496,32 +946,10 @@ static void ct3b_update_irc(struct gs_panel *ctx, const enum gs_hbm_mode hbm_mod
 		GS_DCS_BUF_ADD_CMD(dev, 0x26, 0x00);
 		GS_DCS_BUF_ADD_CMD(dev, 0xF0, 0x55, 0xAA, 0x52, 0x08, 0x00);
 		/* restore the ELVSS after exit HBM2 */
-		if (ctx->panel_rev > PANEL_REV_EVT1_1) {
-			GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x06);
-			GS_DCS_BUF_ADD_CMD(dev, 0xB5, 0x7F, 0x00, 0x60, 0x67);
-			GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x11);
-			GS_DCS_BUF_ADD_CMD(dev, 0xB5, 0x60, 0x60, 0x60, 0x60, 0x60);
-			GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x2D);
-			GS_DCS_BUF_ADD_CMD(dev, 0xB5, 0x25, 0x25, 0x25, 0x25, 0x25, 0x25,
-						0x25, 0x25, 0x25, 0x25, 0x25, 0x25, 0x1E,
-						0x1E, 0x19, 0x19, 0x0F, 0x0F, 0x01, 0x01,
-						0x01, 0x01, 0x01);
-			GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x44);
-			GS_DCS_BUF_ADD_CMD(dev, 0xB5, 0x25, 0x25, 0x25, 0x25, 0x25, 0x25,
-						0x25, 0x25, 0x25, 0x25, 0x25, 0x25, 0x1E,
-						0x1E, 0x19, 0x19, 0x0F, 0x0F, 0x01, 0x01,
-						0x01, 0x01, 0x01);
-		}
+		if (spanel->elvss_normal)
+			ct3b_add_elvss_payload(dev, spanel->elvss_normal);
 
-		if (ctx->panel_rev < PANEL_REV_DVT1) {
-			GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x03);
-			GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0xC0, 0x30);
-		} else {
-			GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0xB0);
-			GS_DCS_BUF_ADD_CMD(dev, 0xBA, 0x00, 0x00, 0x10, 0x11);
-			GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x03);
-			GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0xC0, 0x21);
-		}
+		ct3b_add_irc_payload(dev, spanel->rev_ops->irc_on);
 	}
 }
 
@@ -533,6 +961,10 @@ static u8 ct3b_get_te2_option(struct gs_panel *ctx)
 	if (!ctx || !ctx->current_mode || spanel->force_changeable_te2)
 		return TEX_OPT_CHANGEABLE;
 
+	/* keep the TE2 cadence steady while the outer display is phase locked to it */
+	if (ct3_te_sync_paired(&spanel->te_sync))
+		return TEX_OPT_FIXED;
+
 	if (ctx->current_mode->gs_mode.is_lp_mode ||
 	    (test_bit(FEAT_EARLY_EXIT, sw_status->feat) && sw_status->idle_vrefresh < 30))
 		return TEX_OPT_FIXED;
@@ -542,6 +974,7 @@ static u8 ct3b_get_te2_option(struct gs_panel *ctx)
 
 static void ct3b_update_te2(struct gs_panel *ctx)
 {
+	ct3b_enable_sync(ctx);
 	ctx->te2.option = ct3b_get_te2_option(ctx);
 
 	dev_dbg(ctx->dev,
@@ -550,149 +983,86 @@ static void ct3b_update_te2(struct gs_panel *ctx)
 		ctx->idle_data.panel_idle_vrefresh);
 }
 
-static inline bool is_auto_mode_allowed(struct gs_panel *ctx)
+static void ct3b_te_sync_apply(struct gs_panel *ctx)
 {
-	/* don't want to enable auto mode/early exit during dimming on */
-	if (ctx->dimming_on)
-		return false;
-
-	if (ctx->idle_data.idle_delay_ms) {
-		const unsigned int delta_ms = gs_panel_get_idle_time_delta(ctx);
-
-		if (delta_ms < ctx->idle_data.idle_delay_ms)
-			return false;
-	}
-
-	return ctx->idle_data.panel_idle_enabled;
+	mutex_lock(&ctx->mode_lock);
+	ct3b_enable_sync(ctx);
+	if (gs_is_panel_active(ctx))
+		ct3b_update_te2(ctx);
+	mutex_unlock(&ctx->mode_lock);
 }
 
 static u32 ct3b_get_min_idle_vrefresh(struct gs_panel *ctx,
 				     const struct gs_panel_mode *pmode)
 {
-	const int vrefresh = drm_mode_vrefresh(&pmode->mode);
-	int min_idle_vrefresh = ctx->min_vrefresh;
-
-	if ((min_idle_vrefresh < 0) || !is_auto_mode_allowed(ctx))
-		return 0;
-
-	if (min_idle_vrefresh <= 1)
-		min_idle_vrefresh = 1;
-	else if (min_idle_vrefresh <= 10)
-		min_idle_vrefresh = 10;
-	else if (min_idle_vrefresh <= 30)
-		min_idle_vrefresh = 30;
-	else
-		return 0;
-
-	if (min_idle_vrefresh >= vrefresh) {
-		dev_dbg(ctx->dev, "min idle vrefresh (%d) higher than target (%d)\n",
-				min_idle_vrefresh, vrefresh);
-		return 0;
-	}
-
-	dev_dbg(ctx->dev, "%s: min_idle_vrefresh %d\n", __func__, min_idle_vrefresh);
-
-	return min_idle_vrefresh;
+	/* don't let auto mode drop below the rate content is committed at */
+	return ct3_get_min_idle_vrefresh(ctx, pmode, &to_spanel(ctx)->dimming,
+					 to_spanel(ctx)->cadence.idle_hz);
 }
 
-static void ct3b_set_panel_feat_manual_mode_fi(struct gs_panel *ctx)
+static void ct3b_set_panel_feat_manual_mode_fi(struct gs_panel *ctx, bool enforce)
 {
+	struct ct3_shadow *shadow = &to_spanel(ctx)->shadow;
 	struct device *dev = ctx->dev;
 	bool enabled;
 
 	enabled = test_bit(FEAT_FRAME_MANUAL_FI, ctx->sw_status.feat);
 
 	GS_DCS_BUF_ADD_CMD(dev, 0x2F, 0x00);
-	GS_DCS_BUF_ADD_CMD(dev, 0xF0, 0x55, 0xAA, 0x52, 0x08, 0x00);
-	GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x9C);
-	GS_DCS_BUF_ADD_CMD(dev, 0xBA, enabled ? 0x21 : 0x11);
-	GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x9E);
-	GS_DCS_BUF_ADD_CMD(dev, 0xBA, 0x01);
-	GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0xA0);
-	GS_DCS_BUF_ADD_CMD(dev, 0xBA, 0x01);
-	GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0xA2);
-	GS_DCS_BUF_ADD_CMD(dev, 0xBA, enabled ? 0xA1 : 0x01);
-	GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0xA4);
-	GS_DCS_BUF_ADD_CMD(dev, 0xBA, 0x00, 0x01);
+	ct3_shadow_begin(shadow);
+	CT3_SHADOW_WRITE(dev, shadow, 0x00, 0x9C, enforce, 0xBA, enabled ? 0x21 : 0x11);
+	CT3_SHADOW_WRITE(dev, shadow, 0x00, 0x9E, enforce, 0xBA, 0x01);
+	CT3_SHADOW_WRITE(dev, shadow, 0x00, 0xA0, enforce, 0xBA, 0x01);
+	CT3_SHADOW_WRITE(dev, shadow, 0x00, 0xA2, enforce, 0xBA, enabled ? 0xA1 : 0x01);
+	CT3_SHADOW_WRITE(dev, shadow, 0x00, 0xA4, enforce, 0xBA, 0x00, 0x01);
 	GS_DCS_BUF_ADD_CMD(dev, 0x2F, 0x30);
 	GS_DCS_BUF_ADD_CMD(dev, 0x6D, 0x04);
 
 	dev_dbg(ctx->dev, "%s: manual mode fi %s\n", __func__, enabled ? "enabled" : "disabled");
 }
 
+static int ct3b_fi_rate(u32 hz)
+{
+	switch (hz) {
+	case 60:
+		return CT3B_FI_60HZ;
+	case 30:
+		return CT3B_FI_30HZ;
+	case 10:
+		return CT3B_FI_10HZ;
+	case 1:
+		return CT3B_FI_1HZ;
+	default:
+		return -EINVAL;
+	}
+}
+
 static void ct3b_set_panel_feat_frequency(struct gs_panel *ctx, unsigned long *feat, u32 vrefresh,
 				    u32 idle_vrefresh, bool is_vrr)
 {
+	const struct ct3b_rev_ops *ops = to_spanel(ctx)->rev_ops;
 	struct device *dev = ctx->dev;
-	u8 val;
+	int fi;
 
 	/*
 	 * Description: this sequence possibly overrides some configs early-exit
 	 * and operation set, depending on FI mode.
 	 */
 	if (test_bit(FEAT_FRAME_AUTO, feat)) {
-		/* frame insertion on */
-		GS_DCS_BUF_ADD_CMD(dev, 0x2F, 0x30);
-		/* target frequency */
-		if (idle_vrefresh == 60) {
-			if (ctx->panel_rev < PANEL_REV_EVT1_1)
-				val = 0x00;
-			else
-				val = 0x01;
-		} else if (idle_vrefresh == 30) {
-			if (ctx->panel_rev < PANEL_REV_EVT1_1)
-				val = 0x01;
-			else
-				val = 0x02;
-		} else if (idle_vrefresh == 10) {
-			if (ctx->panel_rev < PANEL_REV_EVT1_1)
-				val = 0x02;
-			else
-				val = 0x03;
-		} else {
-			if (idle_vrefresh != 1)
-				dev_warn(ctx->dev, "%s: unsupported target freq %d (ns)\n",
-					 __func__, idle_vrefresh);
-			/* 1Hz */
-			if (ctx->panel_rev < PANEL_REV_EVT1_1)
-				val = 0x03;
-			else
-				val = 0x04;
+		fi = ct3b_fi_rate(idle_vrefresh);
+		if (fi < 0) {
+			dev_warn(ctx->dev, "%s: unsupported target freq %d (ns)\n",
+				 __func__, idle_vrefresh);
+			fi = CT3B_FI_1HZ;
 		}
-		GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0x6D, val);
+		/* frame insertion on, target frequency */
+		GS_DCS_BUF_ADD_CMD(dev, 0x2F, 0x30);
+		GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0x6D, ops->fi[fi]);
 	} else { /* manual */
-		if (vrefresh == 1) {
-			if (ctx->panel_rev < PANEL_REV_EVT1_1)
-				val = 0x03;
-			else
-				val = 0x04;
-
-			GS_DCS_BUF_ADD_CMD(dev, 0x2F, 0x30);
-			GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0x6D, val);
-		} else if (vrefresh == 10) {
-			if (ctx->panel_rev < PANEL_REV_EVT1_1)
-				val = 0x02;
-			else
-				val = 0x03;
-
-			GS_DCS_BUF_ADD_CMD(dev, 0x2F, 0x30);
-			GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0x6D, val);
-		} else if (vrefresh == 30) {
-			if (ctx->panel_rev < PANEL_REV_EVT1_1)
-				val = 0x01;
-			else
-				val = 0x02;
-
-			GS_DCS_BUF_ADD_CMD(dev, 0x2F, 0x30);
-			GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0x6D, val);
-		} else if (vrefresh == 60) {
-			if (ctx->panel_rev < PANEL_REV_EVT1_1)
-				val = 0x00;
-			else
-				val = 0x01;
-
+		fi = ct3b_fi_rate(vrefresh);
+		if (fi >= 0) {
 			GS_DCS_BUF_ADD_CMD(dev, 0x2F, 0x30);
-			GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0x6D, val);
+			GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0x6D, ops->fi[fi]);
 		} else {
 			if (vrefresh != 120)
 				dev_warn(ctx->dev,
@@ -705,6 +1075,87 @@ static void ct3b_set_panel_feat_frequency(struct gs_panel *ctx, unsigned long *f
 	}
 }
 
+static void ct3b_stats_account(struct ct3b_rr_stats *st, ktime_t now)
+{
+	if (st->cur != CT3B_STATS_OFF)
+		st->states[st->cur].time_ns += ktime_to_ns(ktime_sub(now, st->since));
+	st->since = now;
+}
+
+/**
+ * ct3b_stats_update - record the refresh rate state committed to the panel
+ * @spanel: ct3b panel
+ * @key: new state, NULL once the panel is off
+ * @start: time the commit of the new state started
+ * @tx_packets: packets sent for the transition
+ * @tx_bytes: bytes sent for the transition
+ */
+static void ct3b_stats_update(struct ct3b_panel *spanel, const struct ct3b_rr_state *key,
+			      ktime_t start, u32 tx_packets, u32 tx_bytes)
+{
+	struct ct3b_rr_stats *st = &spanel->stats;
+	const ktime_t now = ktime_get();
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&st->lock, flags);
+	ct3b_stats_account(st, now);
+
+	if (!key) {
+		st->cur = CT3B_STATS_OFF;
+		goto out;
+	}
+
+	for (i = 0; i < st->num_states; i++) {
+		if (!memcmp(&st->states[i].key, key, sizeof(*key)))
+			break;
+	}
+
+	if (i == st->num_states) {
+		if (st->num_states == CT3B_STATS_MAX_STATES) {
+			st->dropped++;
+			st->cur = CT3B_STATS_OFF;
+			goto out;
+		}
+		st->states[i].key = *key;
+		st->num_states++;
+	}
+
+	if (i != st->cur) {
+		if (st->cur != CT3B_STATS_OFF)
+			st->transitions[st->cur][i]++;
+		st->states[i].entries++;
+	}
+	st->states[i].tx_packets += tx_packets;
+	st->states[i].tx_bytes += tx_bytes;
+	st->states[i].cost_ns += ktime_to_ns(ktime_sub(now, start));
+	st->cur = i;
+out:
+	spin_unlock_irqrestore(&st->lock, flags);
+}
+
+static void ct3b_stats_reset(struct ct3b_rr_stats *st)
+{
+	struct ct3b_rr_state key = { 0 };
+	unsigned long flags;
+
+	spin_lock_irqsave(&st->lock, flags);
+	if (st->cur != CT3B_STATS_OFF)
+		key = st->states[st->cur].key;
+	memset(st->states, 0, sizeof(st->states));
+	memset(st->transitions, 0, sizeof(st->transitions));
+	st->num_states = 0;
+	st->dropped = 0;
+	/* keep the current state so that its residency continues to be counted */
+	if (st->cur != CT3B_STATS_OFF) {
+		st->states[0].key = key;
+		st->num_states = 1;
+		st->cur = 0;
+	}
+	st->since = st->reset_ts = ktime_get();
+	spin_unlock_irqrestore(&st->lock, flags);
+}
+
 /**
  * ct3b_set_panel_feat - configure panel features
  * @ctx: gs_panel struct
@@ -718,6 +1169,7 @@ static void ct3b_set_panel_feat(struct gs_panel *ctx, const struct gs_panel_mode
 			       bool enforce)
 {
 	struct device *dev = ctx->dev;
+	struct ct3_shadow *shadow = &to_spanel(ctx)->shadow;
 	struct gs_panel_status *sw_status = &ctx->sw_status;
 	struct gs_panel_status *hw_status = &ctx->hw_status;
 	unsigned long *feat = sw_status->feat;
@@ -726,6 +1178,10 @@ static void ct3b_set_panel_feat(struct gs_panel *ctx, const struct gs_panel_mode
 	u32 te_freq = gs_drm_mode_te_freq(&pmode->mode);
 	bool is_vrr = gs_is_vrr_mode(pmode);
 	DECLARE_BITMAP(changed_feat, FEAT_MAX);
+	const u32 tx_packets = shadow->tx_packets;
+	const u64 tx_bytes = shadow->tx_bytes;
+	struct ct3b_rr_state key = { 0 };
+	ktime_t start;
 
 #ifndef PANEL_FACTORY_BUILD
 	if (!test_bit(FEAT_FRAME_AUTO, feat)) {
@@ -752,25 +1208,22 @@ static void ct3b_set_panel_feat(struct gs_panel *ctx, const struct gs_panel_mode
 		is_vrr, test_bit(FEAT_FRAME_MANUAL_FI, feat), test_bit(FEAT_FRAME_AUTO, feat),
 		idle_vrefresh ?: vrefresh, drm_mode_vrefresh(&pmode->mode), te_freq);
 
+	start = ktime_get();
+
 #ifndef PANEL_FACTORY_BUILD
-	/* TE setting */
+	/* TE setting, unchanged registers are dropped by the shadow cache */
 	sw_status->te.rate_hz = te_freq;
+	ct3_shadow_begin(shadow);
+	CT3_SHADOW_WRITE(dev, shadow, 0x00, 0x00, enforce, 0xBE, 0x47, 0x4A, 0x49, 0x4F);
 	if (te_freq == 60) {
-		GS_DCS_BUF_ADD_CMD(dev, 0xF0, 0x55, 0xAA, 0x52, 0x08, 0x00);
-		GS_DCS_BUF_ADD_CMD(dev, 0xBE, 0x47, 0x4A, 0x49, 0x4F);
-
-		GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x03);
-		GS_DCS_BUF_ADD_CMD(dev, 0x35, 0x01);
-		GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x1C);
-		GS_DCS_BUF_ADD_CMD(dev, 0xBA, 0x01, 0x01, 0x01, 0x01, 0x77, 0x77, 0x77,
+		CT3_SHADOW_WRITE(dev, shadow, 0x00, 0x03, enforce, 0x35, 0x01);
+		CT3_SHADOW_WRITE(dev, shadow, 0x00, 0x1C, enforce,
+				0xBA, 0x01, 0x01, 0x01, 0x01, 0x77, 0x77, 0x77,
 				0x77, 0x77, 0x77, 0x77, 0x77);
 	} else {
-		GS_DCS_BUF_ADD_CMD(dev, 0xF0, 0x55, 0xAA, 0x52, 0x08, 0x00);
-		GS_DCS_BUF_ADD_CMD(dev, 0xBE, 0x47, 0x4A, 0x49, 0x4F);
-		GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x03);
-		GS_DCS_BUF_ADD_CMD(dev, 0x35, 0x00);
-		GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x1C);
-		GS_DCS_BUF_ADD_CMD(dev, 0xBA, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00,
+		CT3_SHADOW_WRITE(dev, shadow, 0x00, 0x03, enforce, 0x35, 0x00);
+		CT3_SHADOW_WRITE(dev, shadow, 0x00, 0x1C, enforce,
+				0xBA, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00,
 				0x00, 0x00, 0x00, 0x00, 0x00);
 	}
 #endif
@@ -796,7 +1249,7 @@ static void ct3b_set_panel_feat(struct gs_panel *ctx, const struct gs_panel_mode
 	 * Manual FI: enable or disable manual mode FI
 	 */
 	if (test_bit(FEAT_FRAME_MANUAL_FI, changed_feat))
-		ct3b_set_panel_feat_manual_mode_fi(ctx);
+		ct3b_set_panel_feat_manual_mode_fi(ctx, enforce);
 
 	/*
 	 * Frequency setting: FI, frequency, idle frequency
@@ -807,6 +1260,18 @@ static void ct3b_set_panel_feat(struct gs_panel *ctx, const struct gs_panel_mode
 	hw_status->idle_vrefresh = idle_vrefresh;
 	hw_status->te.rate_hz = te_freq;
 	bitmap_copy(hw_status->feat, feat, FEAT_MAX);
+
+	key.vrefresh = vrefresh;
+	key.idle_vrefresh = idle_vrefresh;
+	key.te_hz = te_freq;
+	if (test_bit(FEAT_FRAME_AUTO, feat))
+		key.flags |= CT3B_STATS_AUTO;
+	if (test_bit(FEAT_EARLY_EXIT, feat))
+		key.flags |= CT3B_STATS_EARLY_EXIT;
+	if (test_bit(FEAT_FRAME_MANUAL_FI, feat))
+		key.flags |= CT3B_STATS_MANUAL_FI;
+	ct3b_stats_update(to_spanel(ctx), &key, start, shadow->tx_packets - tx_packets,
+			  shadow->tx_bytes - tx_bytes);
 }
 
 /**
@@ -829,8 +1294,9 @@ static void ct3b_update_refresh_mode(struct gs_panel *ctx, const struct gs_panel
 {
 	struct gs_panel_status *sw_status = &ctx->sw_status;
 
-	dev_info(ctx->dev, "%s: mode: %s set idle_vrefresh: %u\n", __func__,
+	dev_dbg(ctx->dev, "%s: mode: %s set idle_vrefresh: %u\n", __func__,
 		pmode->mode.name, idle_vrefresh);
+	ct3_log(ctx, CT3_LOG_REFRESH, drm_mode_vrefresh(&pmode->mode), idle_vrefresh);
 
 	sw_status->idle_vrefresh = idle_vrefresh;
 	/*
@@ -847,6 +1313,22 @@ static void ct3b_update_refresh_mode(struct gs_panel *ctx, const struct gs_panel
 	dev_dbg(ctx->dev, "%s: display state is notified\n", __func__);
 }
 
+static void ct3b_dimming_frame_setting(struct gs_panel *ctx, const struct gs_panel_mode *pmode)
+{
+	struct ct3_dimming *dim = &to_spanel(ctx)->dimming;
+	struct device *dev = ctx->dev;
+
+	/* ramps don't overlap with auto mode, ct3b_set_brightness() turns it off first */
+	if (!ct3_dimming_update(dim, drm_mode_vrefresh(&pmode->mode)))
+		return;
+
+	GS_DCS_BUF_ADD_CMD(dev, 0xF0, 0x55, 0xAA, 0x52, 0x08, 0x00);
+	GS_DCS_BUF_ADD_CMD(dev, 0xB2, 0x19);
+	GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x05);
+	GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0xB2, dim->frames, dim->frames);
+	dev_dbg(dev, "%s: %u frames at %uHz\n", __func__, dim->frames, dim->vrefresh);
+}
+
 static void ct3b_change_frequency(struct gs_panel *ctx, const struct gs_panel_mode *pmode)
 {
 	int vrefresh = drm_mode_vrefresh(&pmode->mode);
@@ -855,6 +1337,8 @@ static void ct3b_change_frequency(struct gs_panel *ctx, const struct gs_panel_mo
 	if (!ctx)
 		return;
 
+	ct3b_dimming_frame_setting(ctx, pmode);
+
 	if (pmode->idle_mode == GIDLE_MODE_ON_INACTIVITY)
 		idle_vrefresh = ct3b_get_min_idle_vrefresh(ctx, pmode);
 
@@ -863,124 +1347,157 @@ static void ct3b_change_frequency(struct gs_panel *ctx, const struct gs_panel_mo
 
 	ct3b_update_refresh_mode(ctx, pmode, idle_vrefresh);
 	ctx->sw_status.te.rate_hz = gs_drm_mode_te_freq(&pmode->mode);
+	ct3_te_sync_update(&to_spanel(ctx)->te_sync);
 
 	dev_dbg(ctx->dev, "%s: change to %uHz\n", __func__, vrefresh);
 }
 
-static void ct3b_panel_idle_notification(struct gs_panel *ctx,
-		u32 display_id, u32 vrefresh, u32 idle_te_vrefresh)
+static int ct3b_aod_level(const struct ct3b_aod_bl *aod, u16 br)
 {
-	char event_string[64];
-	char *envp[] = { event_string, NULL };
-	struct drm_device *dev = ctx->bridge.dev;
+	const int n = ARRAY_SIZE(ct3b_binned_lp);
+	int level = 0;
 
-	if (!dev) {
-		dev_warn(ctx->dev, "%s: drm_device is null\n", __func__);
-	} else {
-		snprintf(event_string, sizeof(event_string),
-			"PANEL_IDLE_ENTER=%u,%u,%u", display_id, vrefresh, idle_te_vrefresh);
-		kobject_uevent_env(&dev->primary->kdev->kobj, KOBJ_CHANGE, envp);
-	}
-}
+	/* the binned LP thresholds are the upper brightness of each level */
+	while (level < n - 1 && br > ct3b_binned_lp[level].bl_threshold)
+		level++;
 
-static void ct3b_wait_one_vblank(struct gs_panel *ctx)
-{
-	struct drm_crtc *crtc = NULL;
+	if (aod->level < 0 || level == aod->level)
+		return level;
 
-	if (ctx->gs_connector->base.state)
-		crtc = ctx->gs_connector->base.state->crtc;
+	/* stay at the current level until brightness is clearly past its edges */
+	if (level > aod->level &&
+	    br <= ct3b_binned_lp[aod->level].bl_threshold + aod->hysteresis)
+		return aod->level;
+	if (level < aod->level &&
+	    br + aod->hysteresis > ct3b_binned_lp[aod->level - 1].bl_threshold)
+		return aod->level;
 
-	PANEL_ATRACE_BEGIN(__func__);
-	if (crtc) {
-		int ret = drm_crtc_vblank_get(crtc);
+	return level;
+}
 
-		if (!ret) {
-			drm_crtc_wait_one_vblank(crtc);
-			drm_crtc_vblank_put(crtc);
-		} else {
-			usleep_range(8350, 8500);
-		}
-	} else {
-		usleep_range(8350, 8500);
-	}
-	PANEL_ATRACE_END(__func__);
+static void ct3b_aod_apply(struct gs_panel *ctx, int level)
+{
+	struct ct3b_aod_bl *aod = &to_spanel(ctx)->aod;
+
+	gs_panel_set_binned_lp_helper(ctx, ct3b_binned_lp[level].bl_threshold);
+	aod->level = level;
+	aod->pending = false;
+	aod->last_change = ktime_get();
+	aod->changes++;
 }
 
-static bool ct3b_set_self_refresh(struct gs_panel *ctx, bool enable)
+static void ct3b_set_binned_lp(struct gs_panel *ctx, u16 br)
 {
-	const struct gs_panel_mode *pmode = ctx->current_mode;
 	struct ct3b_panel *spanel = to_spanel(ctx);
-	struct device *dev = ctx->dev;
-	u32 idle_vrefresh;
+	struct ct3b_aod_bl *aod = &spanel->aod;
+	const int level = ct3b_aod_level(aod, br);
+	s64 dwell_ms;
 
-	dev_dbg(ctx->dev, "%s: %d\n", __func__, enable);
+	ct3b_enable_sync(ctx);
+	if (level == aod->level) {
+		aod->pending = false;
+		return;
+	}
 
-	if (unlikely(!pmode))
-		return false;
+	/*
+	 * hold back changes to an adjacent level, jumps over a level (e.g. walking into
+	 * a bright room) go out right away
+	 */
+	dwell_ms = aod->dwell_ms - ktime_ms_delta(ktime_get(), aod->last_change);
+	if (aod->level >= 0 && abs(level - aod->level) == 1 &&
+	    (ctx->idle_data.panel_idle_vrefresh == 1 || dwell_ms > 0)) {
+		dev_dbg(ctx->dev, "%s: hold back level %d (br %u)\n", __func__, level, br);
+		aod->pending = true;
+		aod->pending_br = br;
+		aod->deferred++;
+		/* self refresh exit sends it otherwise */
+		if (dwell_ms > 0)
+			mod_delayed_work(system_wq, &spanel->aod_work, msecs_to_jiffies(dwell_ms));
+		return;
+	}
 
-	/* self refresh is not supported in lp mode since that always makes use of early exit */
-	if (pmode->gs_mode.is_lp_mode) {
-		/* set 1Hz while self refresh is active, otherwise clear it */
-		ctx->idle_data.panel_idle_vrefresh = enable ? 1 : 0;
-		notify_panel_mode_changed(ctx);
+	ct3b_aod_apply(ctx, level);
+}
 
-		/* 1Hz */
-		if (spanel->needs_aod_idle && ctx->panel_rev >= PANEL_REV_EVT1_1) {
-			GS_DCS_BUF_ADD_CMD(dev, 0x2F, 0x00);
-			GS_DCS_BUF_ADD_CMD(dev, 0xF0, 0x55, 0xAA, 0x52, 0x08, 0x00);
-			GS_DCS_BUF_ADD_CMD(dev, 0xBE, 0x47, 0x4A, 0x49, 0x4F);
-			GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x18);
-			GS_DCS_BUF_ADD_CMD(dev, 0xBB, 0x01, 0x1D);
-			GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0x2F, 0x30);
+/* send a held back level change while the panel is out of 1Hz self refresh */
+static void ct3b_aod_flush(struct gs_panel *ctx)
+{
+	struct ct3b_aod_bl *aod = &to_spanel(ctx)->aod;
+	int level;
 
-			spanel->needs_aod_idle = false;
-		}
+	if (!aod->pending)
+		return;
 
-		return false;
-	}
+	level = ct3b_aod_level(aod, aod->pending_br);
+	if (level != aod->level)
+		ct3b_aod_apply(ctx, level);
+	aod->pending = false;
+}
 
-	idle_vrefresh = ct3b_get_min_idle_vrefresh(ctx, pmode);
+/* the dwell time of a held back level change has passed */
+static void ct3b_aod_work(struct work_struct *work)
+{
+	struct ct3b_panel *spanel = container_of(to_delayed_work(work), struct ct3b_panel,
+						 aod_work);
+	struct gs_panel *ctx = &spanel->base;
+	const struct gs_panel_mode *pmode;
 
-	if (pmode->idle_mode != GIDLE_MODE_ON_SELF_REFRESH) {
-		/*
-		 * if idle mode is on inactivity, may need to update the target fps for auto mode,
-		 * or switch to manual mode if idle should be disabled (idle_vrefresh=0)
-		 */
-		if ((pmode->idle_mode == GIDLE_MODE_ON_INACTIVITY) &&
-			(ctx->sw_status.idle_vrefresh != idle_vrefresh)) {
-			ct3b_update_refresh_mode(ctx, pmode, idle_vrefresh);
-			return true;
-		}
-		return false;
+	mutex_lock(&ctx->mode_lock);
+	pmode = ctx->current_mode;
+	/* in 1Hz self refresh the change goes out with the self refresh exit */
+	if (gs_is_panel_active(ctx) && pmode && pmode->gs_mode.is_lp_mode &&
+	    ctx->idle_data.panel_idle_vrefresh != 1) {
+		ct3b_enable_sync(ctx);
+		ct3b_aod_flush(ctx);
 	}
-	if (!enable)
-		idle_vrefresh = 0;
+	mutex_unlock(&ctx->mode_lock);
+}
 
-	/* if there's no change in idle state then skip cmds */
-	if (ctx->idle_data.panel_idle_vrefresh == idle_vrefresh)
-		return false;
+static u32 ct3b_get_auto_mode_vrefresh(struct gs_panel *ctx)
+{
+	return ctx->sw_status.idle_vrefresh;
+}
 
-	PANEL_ATRACE_BEGIN(__func__);
-	ct3b_update_refresh_mode(ctx, pmode, idle_vrefresh);
+static void ct3b_send_early_exit(struct gs_panel *ctx)
+{
+	GS_DCS_BUF_ADD_CMD_AND_FLUSH(ctx->dev, 0x5A, 0x01);
+}
 
-	if (idle_vrefresh) {
-		const int vrefresh = drm_mode_vrefresh(&pmode->mode);
+static void ct3b_set_lp_self_refresh(struct gs_panel *ctx, bool enable)
+{
+	struct ct3b_panel *spanel = to_spanel(ctx);
+	struct device *dev = ctx->dev;
 
-		ct3b_panel_idle_notification(ctx, 0, vrefresh, 120);
-	} else if (ctx->idle_data.panel_need_handle_idle_exit) {
-		/*
-		 * after exit idle mode with fixed TE at non-120hz, TE may still keep at 120hz.
-		 * If any layer that already be assigned to DPU that can't be handled at 120hz,
-		 * panel_need_handle_idle_exit will be set then we need to wait one vblank to
-		 * avoid underrun issue.
-		 */
-		dev_dbg(ctx->dev, "wait one vblank after exit idle\n");
-		ct3b_wait_one_vblank(ctx);
+	if (!enable)
+		ct3b_aod_flush(ctx);
+
+	/* 1Hz */
+	if (spanel->needs_aod_idle && spanel->rev_ops->lp_early_exit) {
+		GS_DCS_BUF_ADD_CMD(dev, 0x2F, 0x00);
+		ct3_shadow_begin(&spanel->shadow);
+		CT3_SHADOW_WRITE(dev, &spanel->shadow, 0x00, 0x00, true,
+				0xBE, 0x47, 0x4A, 0x49, 0x4F);
+		GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x18);
+		GS_DCS_BUF_ADD_CMD(dev, 0xBB, 0x01, 0x1D);
+		GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0x2F, 0x30);
+
+		spanel->needs_aod_idle = false;
 	}
+}
 
-	PANEL_ATRACE_END(__func__);
+static const struct ct3_vrr_funcs ct3b_vrr_funcs = {
+	.update_refresh_mode = ct3b_update_refresh_mode,
+	.get_min_idle_vrefresh = ct3b_get_min_idle_vrefresh,
+	.get_auto_mode_vrefresh = ct3b_get_auto_mode_vrefresh,
+	.send_early_exit = ct3b_send_early_exit,
+	.set_lp_self_refresh = ct3b_set_lp_self_refresh,
+};
+
+static bool ct3b_set_self_refresh(struct gs_panel *ctx, bool enable)
+{
+	ct3b_enable_sync(ctx);
 
-	return true;
+	return ct3_set_self_refresh(ctx, &to_spanel(ctx)->vrr, enable);
 }
 
 static void ct3b_set_dimming_on(struct gs_panel *ctx,
@@ -989,6 +1506,8 @@ static void ct3b_set_dimming_on(struct gs_panel *ctx,
 	const struct gs_panel_mode *pmode = ctx->current_mode;
 	struct device *dev = ctx->dev;
 
+	ct3b_enable_sync(ctx);
+
 	ctx->dimming_on = dimming_on;
 
 	if (pmode->gs_mode.is_lp_mode) {
@@ -1001,6 +1520,38 @@ static void ct3b_set_dimming_on(struct gs_panel *ctx,
 	dev_dbg(dev, "%s dimming_on=%d\n", __func__, dimming_on);
 }
 
+/* auto mode was held off while brightness ramped, let it lower the refresh rate again */
+static void ct3b_dimming_work(struct work_struct *work)
+{
+	struct ct3b_panel *spanel = container_of(to_delayed_work(work), struct ct3b_panel,
+						 dimming_work);
+	struct gs_panel *ctx = &spanel->base;
+	const struct gs_panel_mode *pmode;
+	u32 idle_vrefresh;
+
+	mutex_lock(&ctx->mode_lock);
+	pmode = ctx->current_mode;
+	if (!gs_is_panel_active(ctx) || !pmode || pmode->gs_mode.is_lp_mode ||
+	    pmode->idle_mode != GIDLE_MODE_ON_INACTIVITY)
+		goto out;
+
+	ct3b_enable_sync(ctx);
+	idle_vrefresh = ct3b_get_min_idle_vrefresh(ctx, pmode);
+	if (idle_vrefresh != ctx->sw_status.idle_vrefresh) {
+		dev_dbg(ctx->dev, "%s: dimming done, idle_vrefresh %u\n", __func__, idle_vrefresh);
+		ct3b_update_refresh_mode(ctx, pmode, idle_vrefresh);
+	}
+out:
+	mutex_unlock(&ctx->mode_lock);
+}
+
+static void ct3b_cancel_dimming_work(void *data)
+{
+	struct ct3b_panel *spanel = data;
+
+	cancel_delayed_work_sync(&spanel->dimming_work);
+}
+
 #ifndef PANEL_FACTORY_BUILD
 static void ct3b_update_refresh_ctrl_feat(struct gs_panel *ctx, const struct gs_panel_mode *pmode)
 {
@@ -1057,6 +1608,8 @@ static void ct3b_refresh_ctrl(struct gs_panel *ctx)
 
 	PANEL_ATRACE_BEGIN(__func__);
 
+	ct3b_enable_sync(ctx);
+
 	ct3b_update_refresh_ctrl_feat(ctx, ctx->current_mode);
 
 	if (ctrl & GS_PANEL_REFRESH_CTRL_FI_FRAME_COUNT_MASK) {
@@ -1072,13 +1625,21 @@ static void ct3b_set_lp_mode(struct gs_panel *ctx, const struct gs_panel_mode *p
 {
 	struct device *dev = ctx->dev;
 	struct ct3b_panel *spanel = to_spanel(ctx);
+	const struct ct3b_rr_state key = {
+		.vrefresh = drm_mode_vrefresh(&pmode->mode),
+		.te_hz = gs_drm_mode_te_freq(&pmode->mode),
+		.flags = CT3B_STATS_LP,
+	};
+	const ktime_t start = ktime_get();
 
 	dev_dbg(ctx->dev, "%s\n", __func__);
 
 	PANEL_ATRACE_BEGIN(__func__);
 
+	ct3b_enable_sync(ctx);
+
 	/* Enable early exit and fixed TE */
-	if (ctx->panel_rev >= PANEL_REV_EVT1_1) {
+	if (to_spanel(ctx)->rev_ops->lp_early_exit) {
 		GS_DCS_BUF_ADD_CMD(dev, 0x5A, 0x00);
 		GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x01);
 		GS_DCS_BUF_ADD_CMD(dev, 0x6D, 0x01);
@@ -1096,6 +1657,10 @@ static void ct3b_set_lp_mode(struct gs_panel *ctx, const struct gs_panel_mode *p
 	ctx->sw_status.te.rate_hz = 30;
 	ctx->sw_status.te.option = TEX_OPT_FIXED;
 	spanel->needs_aod_idle = true;
+	spanel->aod.level = -1;
+	spanel->aod.pending = false;
+	ct3b_stats_update(spanel, &key, start, 0, 0);
+	ct3_te_sync_update(&spanel->te_sync);
 
 	PANEL_ATRACE_END(__func__);
 
@@ -1105,6 +1670,7 @@ static void ct3b_set_lp_mode(struct gs_panel *ctx, const struct gs_panel_mode *p
 static void ct3b_set_nolp_mode(struct gs_panel *ctx,
 				  const struct gs_panel_mode *pmode)
 {
+	struct ct3_shadow *shadow = &to_spanel(ctx)->shadow;
 	struct device *dev = ctx->dev;
 
 	if (!gs_is_panel_active(ctx))
@@ -1112,8 +1678,10 @@ static void ct3b_set_nolp_mode(struct gs_panel *ctx,
 
 	PANEL_ATRACE_BEGIN(__func__);
 
+	ct3b_enable_sync(ctx);
+
 	/* Disable early exit */
-	if (ctx->panel_rev >= PANEL_REV_EVT1_1) {
+	if (to_spanel(ctx)->rev_ops->lp_early_exit) {
 		GS_DCS_BUF_ADD_CMD(dev, 0x5A, 0x01);
 		GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x01);
 		GS_DCS_BUF_ADD_CMD(dev, 0x6D, 0x00);
@@ -1124,9 +1692,9 @@ static void ct3b_set_nolp_mode(struct gs_panel *ctx,
 	GS_DCS_BUF_ADD_CMD(dev, 0xFF, 0xAA, 0x55, 0xA5, 0x81);
 	GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x0E);
 	GS_DCS_BUF_ADD_CMD(dev, 0xF5, 0x2B);
-	if (ctx->panel_rev >= PANEL_REV_EVT1_1) {
-		GS_DCS_BUF_ADD_CMD(dev, 0xF0, 0x55, 0xAA, 0x52, 0x08, 0x00);
-		GS_DCS_BUF_ADD_CMD(dev, 0xBE, 0x5F, 0x4A, 0x49, 0x4F);
+	if (to_spanel(ctx)->rev_ops->lp_early_exit) {
+		ct3_shadow_begin(shadow);
+		CT3_SHADOW_WRITE(dev, shadow, 0x00, 0x00, true, 0xBE, 0x5F, 0x4A, 0x49, 0x4F);
 	}
 
 	GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, MIPI_DCS_WRITE_CONTROL_DISPLAY,
@@ -1141,18 +1709,24 @@ static void ct3b_set_nolp_mode(struct gs_panel *ctx,
 	dev_info(dev, "exit LP mode\n");
 }
 
-static void ct3b_dimming_frame_setting(struct gs_panel *ctx, u8 dimming_frame)
+static void ct3b_enable_setup(struct gs_panel *ctx, const struct gs_panel_mode *pmode)
 {
-	struct device *dev = ctx->dev;
-
-	/* Fixed time 1 frame */
-	if (!dimming_frame)
-		dimming_frame = 0x01;
+	PANEL_ATRACE_BEGIN("ct3b_enable_setup");
+	ct3b_set_panel_feat(ctx, pmode, true);
+	ct3b_change_frequency(ctx, pmode);
+	PANEL_ATRACE_END("ct3b_enable_setup");
+}
 
-	GS_DCS_BUF_ADD_CMD(dev, 0xF0, 0x55, 0xAA, 0x52, 0x08, 0x00);
-	GS_DCS_BUF_ADD_CMD(dev, 0xB2, 0x19);
-	GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x05);
-	GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0xB2, dimming_frame, dimming_frame);
+static void ct3b_enable_work(struct kthread_work *work)
+{
+	struct ct3b_panel *spanel = container_of(work, struct ct3b_panel, enable_work);
+	struct gs_panel *ctx = &spanel->base;
+
+	mutex_lock(&ctx->mode_lock);
+	/* an entry point may have run the stage already through ct3b_enable_sync() */
+	if (xchg(&spanel->enable_pending, false))
+		ct3b_enable_run(spanel);
+	mutex_unlock(&ctx->mode_lock);
 }
 
 static int ct3b_enable(struct drm_panel *panel)
@@ -1170,23 +1744,160 @@ static int ct3b_enable(struct drm_panel *panel)
 
 	PANEL_ATRACE_BEGIN(__func__);
 
-	gs_panel_reset_helper(ctx);
-	gs_panel_send_cmdset(ctx, &ct3b_init_cmdset);
-	ct3b_update_panel_feat(ctx, true);
+	/* stage 1: reset, power rails are already up from prepare */
+	PANEL_ATRACE_BEGIN("ct3b_enable_reset");
+	ct3_prewarm_reset(&spanel->prewarm);
+	ct3_shadow_invalidate(&spanel->shadow);
+	PANEL_ATRACE_END("ct3b_enable_reset");
 
-	ct3b_change_frequency(ctx, pmode);
-	ct3b_dimming_frame_setting(ctx, CT3B_DIMMING_FRAME);
-
-	if (pmode->gs_mode.is_lp_mode)
-		ct3b_set_lp_mode(ctx, pmode);
+	/* stage 2: init sequence, includes sleep out */
+	PANEL_ATRACE_BEGIN("ct3b_enable_init");
+	if (!completion_done(&spanel->probe_done) || ct3_cmd_seq_send(ctx, &spanel->init_seq))
+		gs_panel_send_cmdset(ctx, &ct3b_init_cmdset);
+	PANEL_ATRACE_END("ct3b_enable_init");
 
+	/*
+	 * stage 3: feature and frequency setup doesn't affect scanout, so unless LP mode
+	 * needs it right away, let it run while DPU powers up and renders the first frame.
+	 * DISPLAY_ON in ct3b_commit_done() waits for it.
+	 */
 	spanel->needs_display_on = true;
+	spanel->enable_pmode = pmode;
+	if (spanel->enable_worker && !pmode->gs_mode.is_lp_mode) {
+		reinit_completion(&spanel->enable_done);
+		WRITE_ONCE(spanel->enable_pending, true);
+		kthread_queue_work(spanel->enable_worker, &spanel->enable_work);
+	} else {
+		ct3b_enable_setup(ctx, pmode);
+		if (pmode->gs_mode.is_lp_mode)
+			ct3b_set_lp_mode(ctx, pmode);
+	}
+	ct3_bl_publish_state(&spanel->bl_snapshot);
 
 	PANEL_ATRACE_END(__func__);
 
 	return 0;
 }
 
+/* add the damage of one plane to @roi, in CRTC coordinates */
+static void ct3b_roi_add_plane(struct drm_rect *roi, const struct drm_plane_state *old_state,
+			       struct drm_plane_state *new_state)
+{
+	const int src_y = new_state->src.y1 >> 16;
+	const int src_h = drm_rect_height(&new_state->src) >> 16;
+	struct drm_rect damage;
+
+	if (!drm_atomic_helper_damage_merged(old_state, new_state, &damage))
+		return;
+
+	/* scale the damaged source rows onto the plane's destination */
+	damage.y1 = new_state->dst.y1 +
+		    mult_frac(damage.y1 - src_y, drm_rect_height(&new_state->dst), src_h ?: 1);
+	damage.y2 = new_state->dst.y1 +
+		    DIV_ROUND_UP((damage.y2 - src_y) * drm_rect_height(&new_state->dst),
+				 src_h ?: 1);
+
+	roi->y1 = min(roi->y1, damage.y1);
+	roi->y2 = max(roi->y2, damage.y2);
+}
+
+/**
+ * ct3b_roi_update - compute the dirty window of a checked commit
+ * @ctx: gs_panel struct
+ * @state: atomic state being checked
+ * @old_crtc_state: current CRTC state
+ * @new_crtc_state: new CRTC state
+ *
+ * Merges the plane damage into a window aligned to DSC slice rows. Modesets, plane
+ * changes and windows above @max_percent of the screen count as full frames. The
+ * window is accounted by ct3b_roi_commit() once the commit is done.
+ */
+static void ct3b_roi_update(struct gs_panel *ctx, struct drm_atomic_state *state,
+			    const struct drm_crtc_state *old_crtc_state,
+			    const struct drm_crtc_state *new_crtc_state)
+{
+	struct ct3b_roi *roi_state = &to_spanel(ctx)->roi;
+	const int vdisplay = new_crtc_state->mode.vdisplay;
+	struct drm_crtc *crtc = new_crtc_state->crtc;
+	struct drm_plane_state *old_ps, *new_ps;
+	struct drm_rect roi = { .x1 = 0, .x2 = new_crtc_state->mode.hdisplay,
+				.y1 = vdisplay, .y2 = 0 };
+	struct ct3b_roi_pending *pending;
+	struct drm_plane *plane;
+	bool full = drm_atomic_crtc_needs_modeset(new_crtc_state) ||
+		    new_crtc_state->plane_mask != old_crtc_state->plane_mask;
+	unsigned long flags;
+	int i;
+
+	for_each_oldnew_plane_in_state(state, plane, old_ps, new_ps, i) {
+		if (full)
+			break;
+		if (new_ps->crtc != crtc)
+			continue;
+		/* moved or resized planes dirty both their old and new position */
+		if (!drm_rect_equals(&old_ps->dst, &new_ps->dst)) {
+			full = true;
+			break;
+		}
+		ct3b_roi_add_plane(&roi, old_ps, new_ps);
+	}
+
+	if (!full && roi.y2 <= roi.y1) {
+		/* nothing changed, e.g. a brightness only commit */
+		roi.y1 = roi.y2 = 0;
+	} else if (!full) {
+		roi.y1 = max(rounddown(roi.y1, CT3B_DSC_SLICE_HEIGHT), 0);
+		roi.y2 = min(roundup(roi.y2, CT3B_DSC_SLICE_HEIGHT), vdisplay);
+		full = drm_rect_height(&roi) * 100 > vdisplay * roi_state->max_percent;
+	}
+
+	if (full) {
+		roi.y1 = 0;
+		roi.y2 = vdisplay;
+	}
+
+	spin_lock_irqsave(&roi_state->lock, flags);
+	pending = &roi_state->pending[roi_state->next];
+	roi_state->next = (roi_state->next + 1) % CT3B_ROI_PENDING;
+	pending->key = new_crtc_state;
+	pending->full = full;
+	pending->win = roi;
+	spin_unlock_irqrestore(&roi_state->lock, flags);
+}
+
+/* account the window of the commit that was just done, looked up by its CRTC state */
+static void ct3b_roi_commit(struct gs_panel *ctx)
+{
+	const struct drm_connector_state *conn_state = ctx->gs_connector->base.state;
+	struct ct3b_roi *roi_state = &to_spanel(ctx)->roi;
+	const struct drm_crtc_state *key;
+	struct ct3b_roi_pending *pending;
+	unsigned long flags;
+	unsigned int i;
+
+	if (!conn_state || !conn_state->crtc)
+		return;
+	key = conn_state->crtc->state;
+
+	spin_lock_irqsave(&roi_state->lock, flags);
+	/* newest first, a freed TEST_ONLY state may have been reused */
+	for (i = 1; i <= CT3B_ROI_PENDING; i++) {
+		pending = &roi_state->pending[(roi_state->next + CT3B_ROI_PENDING - i) %
+					      CT3B_ROI_PENDING];
+		if (pending->key != key)
+			continue;
+		roi_state->frames++;
+		if (!pending->full) {
+			roi_state->partial++;
+			roi_state->rows += drm_rect_height(&pending->win);
+		}
+		roi_state->last = pending->win;
+		pending->key = NULL;
+		break;
+	}
+	spin_unlock_irqrestore(&roi_state->lock, flags);
+}
+
 static int ct3b_atomic_check(struct gs_panel *ctx, struct drm_atomic_state *state)
 {
 	struct drm_connector *conn = &ctx->gs_connector->base;
@@ -1196,6 +1907,7 @@ static int ct3b_atomic_check(struct gs_panel *ctx, struct drm_atomic_state *stat
 	const struct gs_panel_mode *pmode;
 	bool was_lp_mode, is_lp_mode = false;
 
+	ct3b_enable_sync(ctx);
 
 	if (!ctx->current_mode || !new_conn_state || !new_conn_state->crtc)
 		return 0;
@@ -1205,6 +1917,9 @@ static int ct3b_atomic_check(struct gs_panel *ctx, struct drm_atomic_state *stat
 	if (!old_crtc_state || !new_crtc_state || !new_crtc_state->active)
 		return 0;
 
+	if (to_spanel(ctx)->roi.enabled)
+		ct3b_roi_update(ctx, state, old_crtc_state, new_crtc_state);
+
 	was_lp_mode = ctx->current_mode->gs_mode.is_lp_mode;
 	pmode = gs_panel_get_mode(ctx, &new_crtc_state->mode);
 	if (pmode)
@@ -1226,6 +1941,10 @@ static int ct3b_atomic_check(struct gs_panel *ctx, struct drm_atomic_state *stat
 	    (was_lp_mode && drm_mode_vrefresh(&new_crtc_state->mode) == 60)) {
 		struct drm_display_mode *mode = &new_crtc_state->adjusted_mode;
 
+		/*
+		 * resume, self refresh exit and lp exit are modesets already, so raising
+		 * the clock here doesn't cost an extra one
+		 */
 		mode->clock = mode->htotal * mode->vtotal * 120 / 1000;
 		if (mode->clock != new_crtc_state->mode.clock) {
 			new_crtc_state->mode_changed = true;
@@ -1235,9 +1954,12 @@ static int ct3b_atomic_check(struct gs_panel *ctx, struct drm_atomic_state *stat
 				!drm_atomic_crtc_effectively_active(old_crtc_state) ?
 				"resume" : "lp exit");
 		}
-	} else if (old_crtc_state->active_changed &&
-		    old_crtc_state->adjusted_mode.clock != old_crtc_state->mode.clock) {
-		/* clock hacked in last commit due to resume or lp exit, undo that */
+	} else if (old_crtc_state->adjusted_mode.clock != old_crtc_state->mode.clock) {
+		/*
+		 * clock raised on resume or lp exit, undo that. decon only reprograms
+		 * the clock on a modeset, so this costs a second modeset per wake until
+		 * gs_drm can drop the override without one.
+		 */
 		new_crtc_state->mode_changed = true;
 		new_crtc_state->adjusted_mode.clock = new_crtc_state->mode.clock;
 		ctx->gs_connector->needs_commit = false;
@@ -1262,6 +1984,7 @@ static int ct3b_disable(struct drm_panel *panel)
 		return 0;
 	}
 
+	ct3b_enable_sync(ctx);
 	spanel->needs_display_on = false;
 	ret = gs_panel_disable(panel);
 	if (ret)
@@ -1272,7 +1995,15 @@ static int ct3b_disable(struct drm_panel *panel)
 	ctx->hw_status.vrefresh = 60;
 	ctx->hw_status.te.rate_hz = 60;
 	ctx->hw_status.idle_vrefresh = 0;
-	spanel->dbv_range = DBV_INIT;
+	spanel->dbv_range = CT3_DBV_ZONE_NONE;
+	spanel->dimming.frames = 0;
+	spanel->dimming.end = 0;
+	cancel_delayed_work(&spanel->dimming_work);
+	cancel_delayed_work(&spanel->aod_work);
+	ct3_shadow_invalidate(&spanel->shadow);
+	ct3b_stats_update(spanel, NULL, 0, 0, 0);
+	ct3_bl_publish(&spanel->bl_snapshot, 0);
+	ct3_te_sync_update(&spanel->te_sync);
 
 	return 0;
 }
@@ -1282,11 +2013,86 @@ static int ct3b_disable(struct drm_panel *panel)
  * time to next vblank. Use just over 2 frames time to consider worst case scenario
  */
 #define EARLY_EXIT_THRESHOLD_US 17000
+/* commit intervals longer than this are idle periods rather than a cadence */
+#define CADENCE_MAX_INTERVAL_US 1000000
+/* moving averages weigh each new interval by 1/8 */
+#define CADENCE_EWMA_SHIFT 3
+
+/**
+ * ct3b_cadence_update - learn the commit cadence and derive early exit policy
+ * @spanel: ct3b panel
+ * @delta_us: time since the previous commit
+ *
+ * With a steady cadence slower than the default threshold (e.g. 24/30fps video
+ * or a 1Hz clock), auto mode is limited to the lowest rate that still keeps up
+ * with the cadence and early exit is only triggered for commits arriving later
+ * than expected. Boosting to 120Hz for every on-time frame would only burn
+ * power. Irregular cadences keep the default threshold and idle target.
+ */
+static void ct3b_cadence_update(struct ct3b_panel *spanel, s64 delta_us)
+{
+	struct ct3b_cadence *c = &spanel->cadence;
+	u32 interval, diff;
+
+	if (!c->enabled || delta_us <= 0 || delta_us > CADENCE_MAX_INTERVAL_US) {
+		c->avg_us = 0;
+		c->dev_us = 0;
+		goto out_default;
+	}
+
+	interval = delta_us;
+	if (!c->avg_us) {
+		c->avg_us = interval;
+		c->dev_us = interval / 2;
+		goto out_default;
+	}
+
+	diff = abs((s32)(interval - c->avg_us));
+	c->avg_us = (s32)c->avg_us + (((s32)interval - (s32)c->avg_us) >> CADENCE_EWMA_SHIFT);
+	c->dev_us = (s32)c->dev_us + (((s32)diff - (s32)c->dev_us) >> CADENCE_EWMA_SHIFT);
+
+	/* treat jitter up to a quarter of the interval as steady */
+	if (c->avg_us <= EARLY_EXIT_THRESHOLD_US || c->dev_us * 4 > c->avg_us)
+		goto out_default;
+
+	c->threshold_us = c->avg_us + 2 * c->dev_us;
+	if (c->avg_us <= USEC_PER_SEC / 30)
+		c->idle_hz = 30;
+	else if (c->avg_us <= USEC_PER_SEC / 10)
+		c->idle_hz = 10;
+	else
+		c->idle_hz = 1;
+	return;
+
+out_default:
+	c->threshold_us = EARLY_EXIT_THRESHOLD_US;
+	c->idle_hz = 0;
+}
+
+/* reprogram the idle target once the cadence predictor picked another idle rate */
+static void ct3b_cadence_retarget(struct gs_panel *ctx)
+{
+	const struct gs_panel_mode *pmode = ctx->current_mode;
+	u32 idle_vrefresh;
+
+	/* the target is only in use while idle is enabled */
+	if (!ctx->sw_status.idle_vrefresh)
+		return;
+
+	idle_vrefresh = ct3b_get_min_idle_vrefresh(ctx, pmode);
+	if (!idle_vrefresh || idle_vrefresh == ctx->sw_status.idle_vrefresh)
+		return;
+
+	dev_dbg(ctx->dev, "cadence idle target %uHz\n", idle_vrefresh);
+	ct3b_update_refresh_mode(ctx, pmode, idle_vrefresh);
+}
 
 /**
  * ct3b_update_idle_state - update panel auto frame insertion state
  * @ctx: panel struct
  *
+ * - sample the commit cadence in manual and auto mode, and reprogram the idle
+ *   target when the cadence predictor settles on another idle rate.
  * - update timestamp of switching to manual mode in case its been a while since the
  *   last frame update and auto mode may have started to lower refresh rate.
  * - trigger early exit by command if it's changeable TE and no switching delay, which
@@ -1295,34 +2101,37 @@ static int ct3b_disable(struct drm_panel *panel)
  */
 static void ct3b_update_idle_state(struct gs_panel *ctx)
 {
-	struct device *dev = ctx->dev;
 	s64 delta_us;
 	struct ct3b_panel *spanel = to_spanel(ctx);
+	const u32 idle_hz = spanel->cadence.idle_hz;
 
 	ctx->idle_data.panel_idle_vrefresh = 0;
-	if (!test_bit(FEAT_FRAME_AUTO, ctx->sw_status.feat))
-		return;
 
 	delta_us = ktime_us_delta(ktime_get(), ctx->timestamps.last_commit_ts);
-	if (delta_us < EARLY_EXIT_THRESHOLD_US) {
+	ct3b_cadence_update(spanel, delta_us);
+
+	if (!test_bit(FEAT_FRAME_AUTO, ctx->sw_status.feat)) {
+		if (spanel->cadence.idle_hz != idle_hz)
+			ct3b_cadence_retarget(ctx);
+		return;
+	}
+
+	if (delta_us < spanel->cadence.threshold_us) {
 		dev_dbg(ctx->dev, "skip early exit. %lldus since last commit\n",
 			delta_us);
+		spanel->cadence.skipped++;
+		if (spanel->cadence.idle_hz != idle_hz)
+			ct3b_cadence_retarget(ctx);
 		return;
 	}
 
-	/* triggering early exit causes a switch to 120hz */
-	ctx->timestamps.last_mode_set_ts = ktime_get();
+	spanel->cadence.early_exits++;
 
 	PANEL_ATRACE_BEGIN(__func__);
-
-	if (!ctx->idle_data.idle_delay_ms && spanel->force_changeable_te) {
-		dev_dbg(ctx->dev, "sending early exit out cmd\n");
-		GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0x5A, 0x01);
-	} else {
-		/* turn off auto mode to prevent panel from lowering frequency too fast */
-		ct3b_update_refresh_mode(ctx, ctx->current_mode, 0);
-	}
-
+	/* if auto mode stays on, give it the target of the new cadence */
+	if (ct3_early_exit(ctx, &spanel->vrr, spanel->force_changeable_te) &&
+	    spanel->cadence.idle_hz != idle_hz)
+		ct3b_cadence_retarget(ctx);
 	PANEL_ATRACE_END(__func__);
 }
 
@@ -1330,6 +2139,11 @@ static void ct3b_commit_done(struct gs_panel *ctx)
 {
 	struct ct3b_panel *spanel = to_spanel(ctx);
 
+	ct3b_enable_sync(ctx);
+
+	if (spanel->roi.enabled)
+		ct3b_roi_commit(ctx);
+
 	if (!ctx->current_mode->gs_mode.is_lp_mode)
 		ct3b_update_idle_state(ctx);
 
@@ -1345,98 +2159,66 @@ static void ct3b_commit_done(struct gs_panel *ctx)
 	dev_info(ctx->dev, "%s: DISPLAY_ON\n", __func__);
 }
 
-static void ct3b_update_ecc_setting(struct gs_panel *ctx)
+static void ct3b_update_ecc_setting(struct gs_panel *ctx, u8 cfg)
 {
 	struct ct3b_panel *spanel = to_spanel(ctx);
 	struct device *dev = ctx->dev;
-	const u8 left_2nits[] = { 0xBD, 0xF7, 0xED, 0xF7, 0xF9, 0xF7, 0xFA, 0xFC,
+	static const u8 left_2nits[] = { 0xBD, 0xF7, 0xED, 0xF7, 0xF9, 0xF7, 0xFA, 0xFC,
 							0xFB, 0xFD, 0xFD, 0xFD, 0xFD };
-	const u8 right_2nits[] = { 0xBD, 0xEB, 0xE4, 0xEF, 0xF2, 0xEF, 0xF5, 0xF9,
+	static const u8 right_2nits[] = { 0xBD, 0xEB, 0xE4, 0xEF, 0xF2, 0xEF, 0xF5, 0xF9,
 							0xF8, 0xFC, 0xFD, 0xFD, 0xFD };
-	const u8 top_2nits[] = { 0xBD, 0xEF, 0xE1, 0xEA, 0xF4, 0xF1, 0xF8, 0xFC,
+	static const u8 top_2nits[] = { 0xBD, 0xEF, 0xE1, 0xEA, 0xF4, 0xF1, 0xF8, 0xFC,
 							0xFC, 0xFC, 0xFD, 0xFD, 0xFD};
-	const u8 bottom_2nits[] = { 0xBD, 0xED, 0xE4, 0xE8, 0xF2, 0xF0, 0xF6, 0xF7,
+	static const u8 bottom_2nits[] = { 0xBD, 0xED, 0xE4, 0xE8, 0xF2, 0xF0, 0xF6, 0xF7,
 							0xFA, 0xFA, 0xFC, 0xFC, 0xFC};
-	const u8 *left = spanel->edge_comp.left_default;
-	const u8 *right = spanel->edge_comp.right_default;
-	const u8 *top = spanel->edge_comp.top_default;
-	const u8 *bottom = spanel->edge_comp.bottom_default;
-	u8 left_config[EDGE_COMPENSATION_SIZE] = { 0 };
-	u8 right_config[EDGE_COMPENSATION_SIZE] = { 0 };
-	u8 top_config[EDGE_COMPENSATION_SIZE] = { 0 };
-	u8 bottom_config[EDGE_COMPENSATION_SIZE] = { 0 };
-
-	switch (spanel->dbv_range) {
-	case DBV_RANGE1:
-		strncpy(left_config, left_2nits, sizeof(left_config));
-		strncpy(right_config, right_2nits, sizeof(right_config));
-		strncpy(top_config, top_2nits, sizeof(top_config));
-		strncpy(bottom_config, bottom_2nits, sizeof(bottom_config));
+	const u8 *left, *right, *top, *bottom;
+
+	switch (cfg) {
+	case CT3B_ECC_2NITS:
+		left = left_2nits;
+		right = right_2nits;
+		top = top_2nits;
+		bottom = bottom_2nits;
 		break;
-	case DBV_RANGE2:
-	case DBV_RANGE3:
-	case DBV_RANGE4:
-	case DBV_RANGE5:
-	case DBV_HBM:
-	case DBV_HBM2:
-		strncpy(left_config, left, sizeof(left_config));
-		strncpy(right_config, right, sizeof(right_config));
-		strncpy(top_config, top, sizeof(top_config));
-		strncpy(bottom_config, bottom, sizeof(bottom_config));
+	case CT3B_ECC_DEFAULT:
+		left = spanel->edge_comp.left_default;
+		right = spanel->edge_comp.right_default;
+		top = spanel->edge_comp.top_default;
+		bottom = spanel->edge_comp.bottom_default;
 		break;
 	default:
-		dev_warn(ctx->dev, "unknown dbv range: %u\n", spanel->dbv_range);
+		dev_warn(ctx->dev, "unknown ecc config: %u\n", cfg);
 		return;
 	}
 
 	GS_DCS_BUF_ADD_CMD(dev, 0xF0, 0x55, 0xAA, 0x52, 0x08, 0x08);
 	GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x1A);
-	GS_DCS_BUF_ADD_CMDLIST(dev, left_config);
+	gs_dsi_dcs_write_buffer(to_mipi_dsi_device(dev), left, EDGE_COMPENSATION_SIZE,
+				GS_DSI_MSG_QUEUE);
 	GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x26);
-	GS_DCS_BUF_ADD_CMDLIST(dev, right_config);
+	gs_dsi_dcs_write_buffer(to_mipi_dsi_device(dev), right, EDGE_COMPENSATION_SIZE,
+				GS_DSI_MSG_QUEUE);
 	GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x32);
-	GS_DCS_BUF_ADD_CMDLIST(dev, top_config);
+	gs_dsi_dcs_write_buffer(to_mipi_dsi_device(dev), top, EDGE_COMPENSATION_SIZE,
+				GS_DSI_MSG_QUEUE);
 	GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x3E);
-	GS_DCS_BUF_ADD_CMDLIST_AND_FLUSH(dev, bottom_config);
+	gs_dsi_dcs_write_buffer(to_mipi_dsi_device(dev), bottom, EDGE_COMPENSATION_SIZE,
+				GS_DSI_MSG_QUEUE);
 }
 
-static void ct3b_update_gamma_setting(struct gs_panel *ctx)
+static void ct3b_update_gamma_setting(struct gs_panel *ctx, u8 cfg)
 {
-	struct ct3b_panel *spanel = to_spanel(ctx);
 	struct device *dev = ctx->dev;
 	u8 config1, config2;
 
-	switch (spanel->dbv_range) {
-	case DBV_RANGE1:
-		config1 = 0x40;
-		config2 = 0xFF;
-		break;
-	case DBV_RANGE2:
-		config1 = 0x2C;
-		config2 = 0xD4;
-		break;
-	case DBV_RANGE3:
-		config1 = 0x1C;
-		config2 = 0x85;
-		break;
-	case DBV_RANGE4:
-		config1 = 0x13;
-		config2 = 0x5C;
-		break;
-	case DBV_RANGE5:
-		config1 = 0x0D;
-		config2 = 0x40;
-		break;
-	case DBV_HBM:
-	case DBV_HBM2:
-		config1 = 0x0B;
-		config2 = 0x36;
-		break;
-	default:
-		dev_warn(dev, "unknown dbv range: %u\n", spanel->dbv_range);
+	if (cfg >= ARRAY_SIZE(ct3b_gamma_configs)) {
+		dev_warn(dev, "unknown gamma config: %u\n", cfg);
 		return;
 	}
 
+	config1 = ct3b_gamma_configs[cfg][0];
+	config2 = ct3b_gamma_configs[cfg][1];
+
 	GS_DCS_BUF_ADD_CMD(dev, 0xF0, 0x55, 0xAA, 0x52, 0x08, 0x04);
 	GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x02);
 	GS_DCS_BUF_ADD_CMD(dev, 0xEC, config1);
@@ -1445,80 +2227,90 @@ static void ct3b_update_gamma_setting(struct gs_panel *ctx)
 	GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0xA5);
 	GS_DCS_BUF_ADD_CMD(dev, 0xEC, config1, config1, config1);
 	GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0xA8);
-	GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0xEC, config2, config2, config2);
+	GS_DCS_BUF_ADD_CMD(dev, 0xEC, config2, config2, config2);
 }
 
-static bool is_dbv_range_changed(struct gs_panel *ctx, u16 br,
-		bool *need_update_gamma, bool *need_update_ecc)
+/**
+ * ct3b_update_dbv_zone - queue the registers that change with the dbv zone
+ * @ctx: gs_panel struct
+ * @br: new dbv
+ *
+ * Only the register groups whose configuration differs between the current and
+ * the new zone are written.
+ */
+static void ct3b_update_dbv_zone(struct gs_panel *ctx, u16 br)
 {
 	struct ct3b_panel *spanel = to_spanel(ctx);
-	enum ct3b_dbv_range req_range;
-
-	if (br >= 0x0001 && br < 0x027D) {
-		req_range = DBV_RANGE1;
-	} else if (br == 0x027D) {
-		req_range = DBV_RANGE2;
-	} else if (br >= 0x027E && br < 0x069D) {
-		req_range = DBV_RANGE3;
-	} else if (br >= 0x069D && br < 0x0AD7) {
-		req_range = DBV_RANGE4;
-	} else if (br >= 0x0AD7 && br < 0x0DA3) {
-		req_range = DBV_RANGE5;
-	} else if (br >= 0x0DA3 && br < 0x0F06) {
-		req_range = DBV_HBM;
-	} else if (br >= 0x0F06 && br <= 0x0FFF) {
-		req_range = DBV_HBM2;
-	} else {
+	const struct ct3_dbv_zone_table *t = &spanel->dbv_zones;
+	unsigned long diff;
+	int zone;
+
+	if (!t->num_zones)
+		return;
+
+	zone = ct3_dbv_zone_select(t, spanel->dbv_range, br);
+	if (zone == CT3_DBV_ZONE_NONE) {
 		dev_err(ctx->dev, "br:%d out of range\n", br);
-		return false;
+		return;
 	}
 
-	if (spanel->dbv_range == req_range)
-		return false;
+	diff = ct3_dbv_zone_diff(t, spanel->dbv_range, zone);
+	spanel->dbv_range = zone;
+	if (!diff)
+		return;
+
+	dev_dbg(ctx->dev, "%s: zone %d, diff %#lx\n", __func__, zone, diff);
 
-	*need_update_gamma = true;
-	*need_update_ecc = !(spanel->dbv_range >= DBV_RANGE2 && req_range >= DBV_RANGE2);
-	spanel->dbv_range = req_range;
-	return true;
+	if (diff & BIT(CT3_ZONE_REG_GAMMA))
+		ct3b_update_gamma_setting(ctx, t->zones[zone].cfg[CT3_ZONE_REG_GAMMA]);
+	if ((diff & BIT(CT3_ZONE_REG_ECC)) && spanel->edge_comp.is_support)
+		ct3b_update_ecc_setting(ctx, t->zones[zone].cfg[CT3_ZONE_REG_ECC]);
 }
 
 static int ct3b_set_brightness(struct gs_panel *ctx, u16 br)
 {
-	struct ct3b_panel *spanel = to_spanel(ctx);
 	struct device *dev = ctx->dev;
-	bool need_update_gamma = false, need_update_ecc = false;
-	u16 brightness;
 
-	if (ctx->current_mode->gs_mode.is_lp_mode) {
-		const struct gs_panel_funcs *funcs;
+	ct3b_enable_sync(ctx);
+	ct3_bl_publish_state(&to_spanel(ctx)->bl_snapshot);
 
-		funcs = ctx->desc->gs_panel_func;
-		if (funcs && funcs->set_binned_lp)
-			funcs->set_binned_lp(ctx, br);
+	if (ctx->current_mode->gs_mode.is_lp_mode) {
+		ct3b_set_binned_lp(ctx, br);
 		return 0;
 	}
 
 	if (GS_IS_HBM_ON_IRC_OFF(ctx->hbm_mode) &&
 		    br == ctx->desc->brightness_desc->brt_capability->hbm.level.max) {
 		/* ACD level.1 */
-		GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0x55, 0x04);
+		GS_DCS_BUF_ADD_CMD(dev, 0x55, 0x04);
 		br = 0xfff;
 	} else {
 		/* ACD off */
-		GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0x55, 0x00);
+		GS_DCS_BUF_ADD_CMD(dev, 0x55, 0x00);
 	}
 
-	if (ctx->panel_rev >= PANEL_REV_EVT1_1 &&
-			is_dbv_range_changed(ctx, br, &need_update_gamma, &need_update_ecc)) {
-		if (need_update_gamma)
-			ct3b_update_gamma_setting(ctx);
-		if (spanel->edge_comp.is_support && need_update_ecc)
-			ct3b_update_ecc_setting(ctx);
-	}
+	ct3b_update_dbv_zone(ctx, br);
+
+	/*
+	 * The ramp length is programmed for the mode's refresh rate, a ramp started while
+	 * auto mode has lowered it would run for far longer. Leave auto mode until
+	 * dimming_work finds the ramp done.
+	 */
+	if (ctx->dimming_on && test_bit(FEAT_FRAME_AUTO, ctx->sw_status.feat))
+		ct3b_update_refresh_mode(ctx, ctx->current_mode, 0);
+
+	/* ACD, gamma and ECC are flushed together with the DBV */
+	ct3_brightness_commit(ctx, br);
 
-	brightness = swab16(br);
+	if (ctx->dimming_on) {
+		struct ct3b_panel *spanel = to_spanel(ctx);
+		const ktime_t end = ct3_dimming_start(&spanel->dimming);
+
+		mod_delayed_work(system_wq, &spanel->dimming_work,
+				 usecs_to_jiffies(ktime_us_delta(end, ktime_get())) + 1);
+	}
 
-	return gs_dcs_set_brightness(ctx, brightness);
+	return 0;
 }
 
 static void ct3b_set_hbm_mode(struct gs_panel *ctx,
@@ -1527,6 +2319,8 @@ static void ct3b_set_hbm_mode(struct gs_panel *ctx,
 	if (ctx->hbm_mode == hbm_mode)
 		return;
 
+	ct3b_enable_sync(ctx);
+
 	ct3b_update_irc(ctx, hbm_mode);
 
 	ctx->hbm_mode = hbm_mode;
@@ -1537,6 +2331,7 @@ static void ct3b_set_hbm_mode(struct gs_panel *ctx,
 static void ct3b_mode_set(struct gs_panel *ctx,
 			     const struct gs_panel_mode *pmode)
 {
+	ct3b_enable_sync(ctx);
 	ct3b_change_frequency(ctx, pmode);
 }
 
@@ -1546,6 +2341,13 @@ static bool ct3b_is_mode_seamless(const struct gs_panel *ctx,
 	const struct drm_display_mode *c = &ctx->current_mode->mode;
 	const struct drm_display_mode *n = &pmode->mode;
 
+	/*
+	 * all modes share one DSC profile and DSI rate today, this only keeps a mode
+	 * added with its own profile from switching without the PPS being sent again
+	 */
+	if (ctx->current_mode->gs_mode.dsc.cfg != pmode->gs_mode.dsc.cfg)
+		return false;
+
 	/* seamless mode set can happen if active region resolution is same */
 	return (c->vdisplay == n->vdisplay) && (c->hdisplay == n->hdisplay);
 }
@@ -1588,71 +2390,73 @@ static void ct3b_get_panel_rev(struct gs_panel *ctx, u32 id)
 	dev_info(ctx->dev, "panel_rev: 0x%x\n", ctx->panel_rev);
 }
 
+#define EDGE_COMPENSATION_ROWS 4
+
 static int ct3b_read_default_compensation(struct gs_panel *ctx)
 {
 	struct mipi_dsi_device *dsi = to_mipi_dsi_device(ctx->dev);
 	struct ct3b_panel *spanel = to_spanel(ctx);
+	struct edge_compensation *comp = &spanel->edge_comp;
 	struct device *dev = ctx->dev;
-	int ret;
-	u8 *left = spanel->edge_comp.left_default;
-	u8 *right = spanel->edge_comp.right_default;
-	u8 *top = spanel->edge_comp.top_default;
-	u8 *bottom = spanel->edge_comp.bottom_default;
-	u8 buf[EDGE_COMPENSATION_SIZE * 2] = {0};
+	const struct {
+		u8 offset;
+		u8 *val;
+	} rows[EDGE_COMPENSATION_ROWS] = {
+		{ 0x1A, comp->left_default },
+		{ 0x26, comp->right_default },
+		{ 0x32, comp->top_default },
+		{ 0x3E, comp->bottom_default },
+	};
+	int i, ret;
 
 	GS_DCS_WRITE_CMD(dev, 0xF0, 0x55, 0xAA, 0x52, 0x08, 0x08);
-	GS_DCS_WRITE_CMD(dev, 0x6F, 0x1A);
-	ret = mipi_dsi_dcs_read(dsi, 0xBD, left + 1, EDGE_COMPENSATION_SIZE - 1);
-	if (ret == (EDGE_COMPENSATION_SIZE - 1)) {
-		left[0] = 0xBD;
-		bin2hex(buf, left + 1, EDGE_COMPENSATION_SIZE - 1);
-
-		dev_info(ctx->dev, "%s: left: %s\n", __func__, buf);
-	} else {
-		dev_err(ctx->dev, "unable to raed left\n");
-		return -EINVAL;
-	}
-
-	GS_DCS_WRITE_CMD(dev, 0x6F, 0x26);
-	memset(buf, 0, sizeof(buf));
-	ret = mipi_dsi_dcs_read(dsi, 0xBD, right + 1, EDGE_COMPENSATION_SIZE - 1);
-	if (ret == (EDGE_COMPENSATION_SIZE - 1)) {
-		right[0] = 0xBD;
-		bin2hex(buf, right + 1, EDGE_COMPENSATION_SIZE - 1);
-
-		dev_info(ctx->dev, "%s: right: %s\n", __func__, buf);
-	} else {
-		dev_err(ctx->dev, "unable to raed right\n");
-		return -EINVAL;
+	for (i = 0; i < EDGE_COMPENSATION_ROWS; i++) {
+		GS_DCS_WRITE_CMD(dev, 0x6F, rows[i].offset);
+		ret = mipi_dsi_dcs_read(dsi, 0xBD, rows[i].val + 1, EDGE_COMPENSATION_SIZE - 1);
+		if (ret != (EDGE_COMPENSATION_SIZE - 1)) {
+			dev_err(dev, "unable to read compensation at 0x%02x (%d)\n",
+				rows[i].offset, ret);
+			ct3_log(ctx, CT3_LOG_READ_ERR, 0xBD, ret);
+			ct3_log_dump("compensation read failed");
+			return -EINVAL;
+		}
+		rows[i].val[0] = 0xBD;
 	}
 
-	GS_DCS_WRITE_CMD(dev, 0x6F, 0x32);
-	memset(buf, 0, sizeof(buf));
-	ret = mipi_dsi_dcs_read(dsi, 0xBD, top + 1, EDGE_COMPENSATION_SIZE - 1);
-	if (ret == (EDGE_COMPENSATION_SIZE - 1)) {
-		top[0] = 0xBD;
-		bin2hex(buf, top + 1, EDGE_COMPENSATION_SIZE - 1);
+	dev_info(dev, "%s: left: %*phN right: %*phN top: %*phN bottom: %*phN\n", __func__,
+		 EDGE_COMPENSATION_SIZE - 1, comp->left_default + 1,
+		 EDGE_COMPENSATION_SIZE - 1, comp->right_default + 1,
+		 EDGE_COMPENSATION_SIZE - 1, comp->top_default + 1,
+		 EDGE_COMPENSATION_SIZE - 1, comp->bottom_default + 1);
 
-		dev_info(ctx->dev, "%s: top: %s\n", __func__, buf);
-	} else {
-		dev_err(ctx->dev, "unable to raed top \n");
-		return -EINVAL;
-	}
+	return 0;
+}
 
-	GS_DCS_WRITE_CMD(dev, 0x6F, 0x3E);
-	memset(buf, 0, sizeof(buf));
-	ret = mipi_dsi_dcs_read(dsi, 0xBD, bottom + 1, EDGE_COMPENSATION_SIZE - 1);
-	if (ret == (EDGE_COMPENSATION_SIZE - 1)) {
-		bottom[0] = 0xBD;
-		bin2hex(buf, bottom + 1, EDGE_COMPENSATION_SIZE - 1);
+/*
+ * defaults passed on by the bootloader save the DSI reads at first enable, they
+ * are a DT property read and loaded synchronously so that read_id can rely on them
+ */
+static void ct3b_load_handoff_compensation(struct device *dev, struct ct3b_panel *spanel)
+{
+	struct edge_compensation *comp = &spanel->edge_comp;
+	u8 *rows[EDGE_COMPENSATION_ROWS] = {
+		comp->left_default, comp->right_default, comp->top_default, comp->bottom_default,
+	};
+	u8 handoff[EDGE_COMPENSATION_ROWS * (EDGE_COMPENSATION_SIZE - 1)];
+	int i;
+
+	if (of_property_read_u8_array(dev->of_node, "google,edge-compensation",
+				      handoff, sizeof(handoff)))
+		return;
 
-		dev_info(ctx->dev, "%s: bottom: %s\n", __func__, buf);
-	} else {
-		dev_err(ctx->dev, "unable to raed bottom\n");
-		return -EINVAL;
+	for (i = 0; i < EDGE_COMPENSATION_ROWS; i++) {
+		rows[i][0] = 0xBD;
+		memcpy(rows[i] + 1, handoff + i * (EDGE_COMPENSATION_SIZE - 1),
+		       EDGE_COMPENSATION_SIZE - 1);
 	}
+	comp->is_support = true;
 
-	return 0;
+	dev_dbg(dev, "%s: edge compensation from bootloader\n", __func__);
 }
 
 static int ct3b_read_id(struct gs_panel *ctx)
@@ -1663,18 +2467,24 @@ static int ct3b_read_id(struct gs_panel *ctx)
 	char buf[CT3B_DDIC_ID_LEN] = {0};
 	int ret;
 
-	GS_DCS_WRITE_CMD(dev, 0xFF, 0xAA, 0x55, 0xA5, 0x81);
-	ret = mipi_dsi_dcs_read(dsi, 0xF2, buf, CT3B_DDIC_ID_LEN);
-	if (ret != CT3B_DDIC_ID_LEN) {
-		dev_warn(ctx->dev, "Unable to read DDIC id (%d)\n", ret);
+	/* DDIC id and compensation defaults are factory OTP, only read them once */
+	if (!spanel->ddic_id_cached) {
+		GS_DCS_WRITE_CMD(dev, 0xFF, 0xAA, 0x55, 0xA5, 0x81);
+		ret = mipi_dsi_dcs_read(dsi, 0xF2, buf, CT3B_DDIC_ID_LEN);
+		if (ret != CT3B_DDIC_ID_LEN) {
+			dev_warn(ctx->dev, "Unable to read DDIC id (%d)\n", ret);
+			ct3_log(ctx, CT3_LOG_READ_ERR, 0xF2, ret);
+			ct3_log_dump("DDIC id read failed");
+			GS_DCS_WRITE_CMD(dev, 0xFF, 0xAA, 0x55, 0xA5, 0x00);
+			return ret;
+		}
 		GS_DCS_WRITE_CMD(dev, 0xFF, 0xAA, 0x55, 0xA5, 0x00);
-		return ret;
-	}
-	GS_DCS_WRITE_CMD(dev, 0xFF, 0xAA, 0x55, 0xA5, 0x00);
 
-	bin2hex(ctx->panel_id, buf, CT3B_DDIC_ID_LEN);
+		bin2hex(ctx->panel_id, buf, CT3B_DDIC_ID_LEN);
+		spanel->ddic_id_cached = true;
+	}
 
-	if (ctx->panel_rev < PANEL_REV_EVT1_1)
+	if (ctx->panel_rev < PANEL_REV_EVT1_1 || spanel->edge_comp.is_support)
 		return 0;
 
 	spanel->edge_comp.is_support = !ct3b_read_default_compensation(ctx);
@@ -1692,7 +2502,7 @@ static const struct gs_display_underrun_param underrun_param = {
 
 static const struct drm_dsc_config ct3b_dsc_cfg = {
 	.slice_count = 2,
-	.slice_height = 12,
+	.slice_height = CT3B_DSC_SLICE_HEIGHT,
 	.initial_dec_delay = 795,
 	.first_line_bpg_offset = 12,
 	.rc_range_params = {
@@ -1874,35 +2684,151 @@ static const struct gs_panel_mode_array ct3b_lp_mode = {
 	},
 };
 
-static int spanel_get_brightness(struct thermal_zone_device *tzd, int *temp)
+static int ct3b_cadence_show(struct seq_file *m, void *data)
 {
-	struct ct3b_panel *spanel;
+	const struct ct3b_cadence *c = m->private;
 
-	if (tzd == NULL)
-		return -EINVAL;
+	seq_printf(m, "adaptive: %d\n", c->enabled);
+	seq_printf(m, "avg_interval_us: %u\n", c->avg_us);
+	seq_printf(m, "deviation_us: %u\n", c->dev_us);
+	seq_printf(m, "threshold_us: %u\n", c->threshold_us);
+	seq_printf(m, "idle_target_hz: %u\n", c->idle_hz);
+	seq_printf(m, "early_exits: %u\n", c->early_exits);
+	seq_printf(m, "skipped: %u\n", c->skipped);
 
-	spanel = tzd->devdata;
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ct3b_cadence);
 
-	if (spanel && spanel->base.bl) {
-		mutex_lock(&spanel->base.bl_state_lock);
-		*temp = (spanel->base.bl->props.state & BL_STATE_STANDBY) ?
-					0 : spanel->base.bl->props.brightness;
-		mutex_unlock(&spanel->base.bl_state_lock);
-	} else {
+static void ct3b_stats_print_state(struct seq_file *m, const struct ct3b_rr_state *key)
+{
+	seq_printf(m, "%u", key->vrefresh);
+	if (key->idle_vrefresh)
+		seq_printf(m, "-%u", key->idle_vrefresh);
+	seq_printf(m, "@te%u%s%s%s%s", key->te_hz,
+		   (key->flags & CT3B_STATS_AUTO) ? ",auto" : "",
+		   (key->flags & CT3B_STATS_EARLY_EXIT) ? ",ee" : "",
+		   (key->flags & CT3B_STATS_MANUAL_FI) ? ",mfi" : "",
+		   (key->flags & CT3B_STATS_LP) ? ",lp" : "");
+}
+
+static int ct3b_stats_residency_show(struct seq_file *m, void *data)
+{
+	struct ct3b_rr_stats *st = m->private;
+	unsigned long flags;
+	int i, j;
+
+	spin_lock_irqsave(&st->lock, flags);
+	ct3b_stats_account(st, ktime_get());
+
+	seq_printf(m, "since_reset_ms: %lld\n", ktime_ms_delta(st->since, st->reset_ts));
+	seq_printf(m, "dropped: %u\n", st->dropped);
+	seq_puts(m, "state\ttime_ms\tentries\ttx_packets\ttx_bytes\tcost_us\n");
+	for (i = 0; i < st->num_states; i++) {
+		if (i == st->cur)
+			seq_puts(m, "*");
+		ct3b_stats_print_state(m, &st->states[i].key);
+		seq_printf(m, "\t%llu\t%u\t%u\t%llu\t%llu\n",
+			   div_u64(st->states[i].time_ns, NSEC_PER_MSEC), st->states[i].entries,
+			   st->states[i].tx_packets, st->states[i].tx_bytes,
+			   div_u64(st->states[i].cost_ns, NSEC_PER_USEC));
+	}
+
+	seq_puts(m, "\ntransitions (from: to=count)\n");
+	for (i = 0; i < st->num_states; i++) {
+		ct3b_stats_print_state(m, &st->states[i].key);
+		seq_puts(m, ":");
+		for (j = 0; j < st->num_states; j++) {
+			if (st->transitions[i][j])
+				seq_printf(m, " %d=%u", j, st->transitions[i][j]);
+		}
+		seq_puts(m, "\n");
+	}
+	spin_unlock_irqrestore(&st->lock, flags);
+
+	return 0;
+}
+
+static int ct3b_dimming_ms_get(void *data, u64 *val)
+{
+	struct gs_panel *ctx = data;
+
+	*val = to_spanel(ctx)->dimming.duration_ms;
+
+	return 0;
+}
+
+/* send the new frame count right away rather than at the next refresh rate change */
+static int ct3b_dimming_ms_set(void *data, u64 val)
+{
+	struct gs_panel *ctx = data;
+	struct ct3_dimming *dim = &to_spanel(ctx)->dimming;
+	const struct gs_panel_mode *pmode;
+
+	if (!val || val > U32_MAX)
 		return -EINVAL;
+
+	mutex_lock(&ctx->mode_lock);
+	dim->duration_ms = val;
+	pmode = ctx->current_mode;
+	if (gs_is_panel_active(ctx) && pmode && !pmode->gs_mode.is_lp_mode) {
+		ct3b_enable_sync(ctx);
+		ct3b_dimming_frame_setting(ctx, pmode);
+	} else {
+		/* resent once the panel is back in normal mode */
+		dim->frames = 0;
 	}
+	mutex_unlock(&ctx->mode_lock);
 
 	return 0;
 }
 
-static struct thermal_zone_device_ops spanel_tzd_ops = {
-	.get_temp = spanel_get_brightness,
+DEFINE_DEBUGFS_ATTRIBUTE(ct3b_dimming_ms_fops, ct3b_dimming_ms_get, ct3b_dimming_ms_set, "%llu\n");
+
+static int ct3b_stats_residency_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ct3b_stats_residency_show, inode->i_private);
+}
+
+static ssize_t ct3b_stats_residency_write(struct file *file, const char __user *buf,
+					  size_t count, loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+
+	ct3b_stats_reset(m->private);
+
+	return count;
+}
+
+static const struct file_operations ct3b_stats_residency_fops = {
+	.owner = THIS_MODULE,
+	.open = ct3b_stats_residency_open,
+	.read = seq_read,
+	.write = ct3b_stats_residency_write,
+	.llseek = seq_lseek,
+	.release = single_release,
 };
 
+static int ct3b_roi_show(struct seq_file *m, void *data)
+{
+	const struct ct3b_roi *roi = m->private;
+
+	seq_printf(m, "enabled: %d\n", roi->enabled);
+	seq_printf(m, "max_percent: %u\n", roi->max_percent);
+	seq_printf(m, "frames: %u\n", roi->frames);
+	seq_printf(m, "partial: %u\n", roi->partial);
+	seq_printf(m, "avg_partial_rows: %llu\n",
+		   roi->partial ? div_u64(roi->rows, roi->partial) : 0);
+	seq_printf(m, "last: " DRM_RECT_FMT "\n", DRM_RECT_ARG(&roi->last));
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ct3b_roi);
+
 static void ct3b_debugfs_init(struct drm_panel *panel, struct dentry *root)
 {
 	struct gs_panel *ctx = container_of(panel, struct gs_panel, base);
-	struct dentry *panel_root, *csroot;
+	struct dentry *panel_root, *csroot, *statsroot;
 
 	if (!ctx)
 		return;
@@ -1911,11 +2837,45 @@ static void ct3b_debugfs_init(struct drm_panel *panel, struct dentry *root)
 	if (!panel_root)
 		return;
 
+	ct3_dsi_prof_debugfs_init(panel_root);
+
+	debugfs_create_bool("shadow_regs", 0600, panel_root, &to_spanel(ctx)->shadow.enabled);
+	debugfs_create_bool("adaptive_early_exit", 0600, panel_root,
+			    &to_spanel(ctx)->cadence.enabled);
+	debugfs_create_file("early_exit", 0400, panel_root, &to_spanel(ctx)->cadence,
+			    &ct3b_cadence_fops);
+	debugfs_create_file_unsafe("dimming_ms", 0600, panel_root, ctx, &ct3b_dimming_ms_fops);
+	debugfs_create_u8("dimming_frames", 0400, panel_root, &to_spanel(ctx)->dimming.frames);
+	debugfs_create_u32("aod_hysteresis", 0600, panel_root, &to_spanel(ctx)->aod.hysteresis);
+	debugfs_create_u32("aod_dwell_ms", 0600, panel_root, &to_spanel(ctx)->aod.dwell_ms);
+	debugfs_create_u32("aod_changes", 0400, panel_root, &to_spanel(ctx)->aod.changes);
+	debugfs_create_u32("aod_deferred", 0400, panel_root, &to_spanel(ctx)->aod.deferred);
+	debugfs_create_bool("roi_stats_enabled", 0600, panel_root, &to_spanel(ctx)->roi.enabled);
+	debugfs_create_u32("roi_stats_max_percent", 0600, panel_root,
+			   &to_spanel(ctx)->roi.max_percent);
+	debugfs_create_file("roi_stats", 0400, panel_root, &to_spanel(ctx)->roi,
+			    &ct3b_roi_fops);
+	debugfs_create_bool("touch_boost", 0600, panel_root, &to_spanel(ctx)->touch_boost.enabled);
+	debugfs_create_u32("touch_boost_interval_ms", 0600, panel_root,
+			   &to_spanel(ctx)->touch_boost.interval_ms);
+	debugfs_create_u32("touch_boost_timeout_ms", 0600, panel_root,
+			   &to_spanel(ctx)->touch_boost.timeout_ms);
+	debugfs_create_u32("touch_boosts", 0400, panel_root, &to_spanel(ctx)->touch_boost.boosts);
+	debugfs_create_u32("touch_boosts_expired", 0400, panel_root,
+			   &to_spanel(ctx)->touch_boost.expired);
+
+	/* writing anything to residency resets the statistics */
+	statsroot = debugfs_create_dir("stats", panel_root);
+	debugfs_create_file("residency", 0600, statsroot, &to_spanel(ctx)->stats,
+			    &ct3b_stats_residency_fops);
+
 	csroot = debugfs_lookup("cmdsets", panel_root);
 	if (!csroot)
 		goto panel_out;
 
 	gs_panel_debugfs_create_cmdset(csroot, &ct3b_init_cmdset, "init");
+	/* packed for the panel revision, can be saved as google,init-seq-firmware */
+	debugfs_create_blob("init_packed", 0400, csroot, &to_spanel(ctx)->init_seq.blob);
 	dput(csroot);
 panel_out:
 	dput(panel_root);
@@ -1925,6 +2885,7 @@ static void ct3b_panel_init(struct gs_panel *ctx)
 {
 	const struct gs_panel_mode *pmode = ctx->current_mode;
 
+	ct3b_enable_sync(ctx);
 #ifdef PANEL_FACTORY_BUILD
 	ctx->idle_data.panel_idle_enabled = false;
 	set_bit(FEAT_FRAME_AUTO, ctx->sw_status.feat);
@@ -1935,14 +2896,234 @@ static void ct3b_panel_init(struct gs_panel *ctx)
 #endif
 
 	/* re-init panel to decouple bootloader settings */
+	to_spanel(ctx)->dimming.frames = 0;
 	if (pmode) {
 		dev_info(ctx->dev, "%s: set mode: %s\n", __func__, pmode->mode.name);
 		ctx->sw_status.idle_vrefresh = 0;
 		ct3b_set_panel_feat(ctx, pmode, true);
 		ct3b_change_frequency(ctx, pmode);
 	}
+}
 
-	ct3b_dimming_frame_setting(ctx, CT3B_DIMMING_FRAME);
+static void ct3b_destroy_enable_worker(void *data)
+{
+	kthread_destroy_worker(data);
+}
+
+static int ct3b_prepare(struct drm_panel *panel)
+{
+	struct gs_panel *ctx = container_of(panel, struct gs_panel, base);
+
+	return ct3_prewarm_prepare(&to_spanel(ctx)->prewarm);
+}
+
+static int ct3b_unprepare(struct drm_panel *panel)
+{
+	struct gs_panel *ctx = container_of(panel, struct gs_panel, base);
+
+	return ct3_prewarm_unprepare(&to_spanel(ctx)->prewarm);
+}
+
+static void ct3b_touch_boost_work(struct work_struct *work)
+{
+	struct ct3b_panel *spanel = container_of(work, struct ct3b_panel, touch_boost.work);
+	struct gs_panel *ctx = &spanel->base;
+	bool manual = false;
+
+	mutex_lock(&ctx->mode_lock);
+	if (!gs_is_panel_active(ctx) || !ctx->current_mode ||
+	    ctx->current_mode->gs_mode.is_lp_mode ||
+	    !test_bit(FEAT_FRAME_AUTO, ctx->sw_status.feat))
+		goto out;
+
+	PANEL_ATRACE_BEGIN(__func__);
+	ct3b_enable_sync(ctx);
+	/* with early exit the panel drops back on its own if no frame follows */
+	manual = !ct3_early_exit(ctx, &spanel->vrr, spanel->force_changeable_te);
+	spanel->touch_boost.boosts++;
+	PANEL_ATRACE_END(__func__);
+out:
+	mutex_unlock(&ctx->mode_lock);
+
+	if (manual)
+		mod_delayed_work(system_wq, &spanel->touch_boost.timeout_work,
+				 msecs_to_jiffies(spanel->touch_boost.timeout_ms));
+}
+
+static void ct3b_touch_boost_timeout_work(struct work_struct *work)
+{
+	struct ct3b_panel *spanel = container_of(to_delayed_work(work), struct ct3b_panel,
+						 touch_boost.timeout_work);
+	struct gs_panel *ctx = &spanel->base;
+	const ktime_t boost = ns_to_ktime(atomic64_read(&spanel->touch_boost.last));
+	const struct gs_panel_mode *pmode;
+
+	mutex_lock(&ctx->mode_lock);
+	pmode = ctx->current_mode;
+	/* a frame since the boost hands idle handling back to the commit path */
+	if (gs_is_panel_active(ctx) && pmode && !pmode->gs_mode.is_lp_mode &&
+	    pmode->idle_mode == GIDLE_MODE_ON_INACTIVITY &&
+	    !test_bit(FEAT_FRAME_AUTO, ctx->sw_status.feat) &&
+	    ktime_before(ctx->timestamps.last_commit_ts, boost)) {
+		ct3b_enable_sync(ctx);
+		ct3b_update_refresh_mode(ctx, pmode, ct3b_get_min_idle_vrefresh(ctx, pmode));
+		spanel->touch_boost.expired++;
+	}
+	mutex_unlock(&ctx->mode_lock);
+}
+
+static void ct3b_touch_boost_event(struct input_handle *handle, unsigned int type,
+				   unsigned int code, int value)
+{
+	struct ct3b_panel *spanel = handle->private;
+	const s64 now = ktime_get_ns();
+	s64 last;
+
+	if (type != EV_KEY || code != BTN_TOUCH || !value || !spanel->touch_boost.enabled)
+		return;
+
+	last = atomic64_read(&spanel->touch_boost.last);
+	if (now - last < (s64)spanel->touch_boost.interval_ms * NSEC_PER_MSEC)
+		return;
+	if (atomic64_cmpxchg(&spanel->touch_boost.last, last, now) != last)
+		return;
+
+	queue_work(system_highpri_wq, &spanel->touch_boost.work);
+}
+
+/* only listen to the touch controller mapped to this panel */
+static bool ct3b_touch_boost_match(struct input_handler *handler, struct input_dev *dev)
+{
+	const struct ct3b_panel *spanel = handler->private;
+	const struct device *parent;
+
+	/* the input device may sit below a core device of the controller */
+	for (parent = dev->dev.parent; parent; parent = parent->parent) {
+		if (parent->of_node == spanel->touch_boost.np)
+			return true;
+	}
+
+	return false;
+}
+
+static const struct input_device_id ct3b_touch_boost_ids[] = {
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT | INPUT_DEVICE_ID_MATCH_KEYBIT |
+			 INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.evbit = { BIT_MASK(EV_KEY) | BIT_MASK(EV_ABS) },
+		.keybit = { [BIT_WORD(BTN_TOUCH)] = BIT_MASK(BTN_TOUCH) },
+		.absbit = { [BIT_WORD(ABS_MT_POSITION_X)] = BIT_MASK(ABS_MT_POSITION_X) },
+	},
+	{ },
+};
+
+static void ct3b_touch_boost_remove(struct ct3b_panel *spanel)
+{
+	if (!spanel->touch_boost.registered)
+		return;
+
+	input_unregister_handler(&spanel->touch_boost.handler);
+	cancel_work_sync(&spanel->touch_boost.work);
+	cancel_delayed_work_sync(&spanel->touch_boost.timeout_work);
+	of_node_put(spanel->touch_boost.np);
+	spanel->touch_boost.np = NULL;
+	spanel->touch_boost.registered = false;
+}
+
+/**
+ * ct3b_touch_boost_init - set up touch triggered idle exit
+ * @spanel: ct3b panel
+ *
+ * A touch down sends the early exit command, or turns auto mode off if early exit
+ * can't be used, before the app's first frame reaches the commit path. Boosts are
+ * rate limited, and auto mode comes back after the timeout if no frame followed.
+ * Touch drivers don't need to know about the panel, touch down is picked up from
+ * the input core, but only from the controller the "touch" phandle points at. The
+ * handler is registered whenever that phandle is there so that the touch_boost
+ * debugfs knob works, "google,touch-early-exit" turns boosting on by default.
+ */
+static void ct3b_touch_boost_init(struct ct3b_panel *spanel)
+{
+	struct device *dev = spanel->base.dev;
+	struct input_handler *handler = &spanel->touch_boost.handler;
+
+	INIT_WORK(&spanel->touch_boost.work, ct3b_touch_boost_work);
+	INIT_DELAYED_WORK(&spanel->touch_boost.timeout_work, ct3b_touch_boost_timeout_work);
+	spanel->touch_boost.interval_ms = CT3B_TOUCH_BOOST_INTERVAL_MS;
+	spanel->touch_boost.timeout_ms = CT3B_TOUCH_BOOST_TIMEOUT_MS;
+
+	spanel->touch_boost.np = of_parse_phandle(dev->of_node, "touch", 0);
+	if (!spanel->touch_boost.np)
+		return;
+
+	handler->name = "ct3b_touch_boost";
+	handler->private = spanel;
+	handler->event = ct3b_touch_boost_event;
+	handler->match = ct3b_touch_boost_match;
+	handler->connect = ct3_input_connect;
+	handler->disconnect = ct3_input_disconnect;
+	handler->id_table = ct3b_touch_boost_ids;
+
+	if (input_register_handler(handler)) {
+		dev_warn(dev, "failed to register touch handler\n");
+		of_node_put(spanel->touch_boost.np);
+		spanel->touch_boost.np = NULL;
+		return;
+	}
+
+	spanel->touch_boost.registered = true;
+	spanel->touch_boost.enabled = of_property_read_bool(dev->of_node,
+							    "google,touch-early-exit");
+}
+
+/*
+ * Pack the init commands for this panel revision so that enable streams them without
+ * revision checks. "google,init-seq-firmware" names a file that replaces them, for
+ * tuning the sequence without rebuilding the kernel.
+ */
+static void ct3b_init_seq_setup(struct ct3b_panel *spanel)
+{
+	struct gs_panel *ctx = &spanel->base;
+	struct device *dev = ctx->dev;
+	const char *name;
+	int ret;
+
+	ret = ct3_cmd_seq_build(dev, &spanel->init_seq, &ct3b_init_cmdset, ctx->panel_rev);
+	if (ret)
+		dev_warn(dev, "failed to pack init commands (%d)\n", ret);
+
+	if (of_property_read_string(dev->of_node, "google,init-seq-firmware", &name))
+		return;
+
+	ret = ct3_cmd_seq_load(dev, &spanel->init_seq, name, ctx->panel_rev);
+	if (ret)
+		dev_warn(dev, "%s not loaded (%d), using built in init commands\n", name, ret);
+}
+
+/*
+ * Probe steps that the boot splash doesn't depend on run from here, so they
+ * don't hold up loading the panel drivers from vendor_kernel_boot.
+ */
+static void ct3b_probe_work(struct work_struct *work)
+{
+	struct ct3b_panel *spanel = container_of(work, struct ct3b_panel, probe_work);
+	struct device *dev = spanel->base.dev;
+
+	if (ct3_bl_thermal_init(dev, &spanel->bl_snapshot, "inner_brightness"))
+		dev_warn(dev, "failed to set up brightness thermal zone\n");
+	ct3_prewarm_register(&spanel->prewarm);
+	ct3b_touch_boost_init(spanel);
+	ct3b_init_seq_setup(spanel);
+
+	complete_all(&spanel->probe_done);
+}
+
+static void ct3b_cancel_probe_work(void *data)
+{
+	struct ct3b_panel *spanel = data;
+
+	cancel_work_sync(&spanel->probe_work);
+	complete_all(&spanel->probe_done);
 }
 
 static int ct3b_panel_probe(struct mipi_dsi_device *dsi)
@@ -1957,39 +3138,107 @@ static int ct3b_panel_probe(struct mipi_dsi_device *dsi)
 
 	ctx = &spanel->base;
 
-	ctx->thermal = devm_kzalloc(&dsi->dev, sizeof(*ctx->thermal), GFP_KERNEL);
-	if (!ctx->thermal) {
-		devm_kfree(&dsi->dev, spanel);
-		return -ENOMEM;
-	}
-
 	ctx->hw_status.vrefresh = 60;
 	ctx->hw_status.te.rate_hz = 60;
 	/* always use fixed TE */
 	ctx->hw_status.te.option = TEX_OPT_FIXED;
-	spanel->dbv_range = DBV_INIT;
+	spanel->dbv_range = CT3_DBV_ZONE_NONE;
+	/* until panel_config() knows the revision */
+	spanel->rev_ops = &ct3b_rev_ops_dvt1;
+	spanel->shadow.enabled = true;
+	ct3_shadow_invalidate(&spanel->shadow);
+	ct3_te_init(&dsi->dev, &spanel->te);
+	ret = ct3_bl_snapshot_init(&dsi->dev, &spanel->bl_snapshot, ctx);
+	if (ret)
+		return ret;
+	spanel->vrr.funcs = &ct3b_vrr_funcs;
+	spanel->vrr.te = &spanel->te;
+	spanel->cadence.enabled = true;
+	spanel->cadence.threshold_us = EARLY_EXIT_THRESHOLD_US;
+	spanel->aod.level = -1;
+	spanel->aod.hysteresis = CT3B_AOD_HYSTERESIS;
+	spanel->aod.dwell_ms = CT3B_AOD_DWELL_MS;
+	of_property_read_u32(dsi->dev.of_node, "google,aod-hysteresis", &spanel->aod.hysteresis);
+	of_property_read_u32(dsi->dev.of_node, "google,aod-dwell-ms", &spanel->aod.dwell_ms);
+	INIT_DELAYED_WORK(&spanel->aod_work, ct3b_aod_work);
+	spanel->dimming.duration_ms = CT3_DIMMING_MS;
+	of_property_read_u32(dsi->dev.of_node, "google,dimming-ms", &spanel->dimming.duration_ms);
+	INIT_DELAYED_WORK(&spanel->dimming_work, ct3b_dimming_work);
+	ret = devm_add_action_or_reset(&dsi->dev, ct3b_cancel_dimming_work, spanel);
+	if (ret)
+		return ret;
+	spin_lock_init(&spanel->roi.lock);
+	spanel->roi.max_percent = CT3B_ROI_MAX_PERCENT;
+	spin_lock_init(&spanel->stats.lock);
+	spanel->stats.cur = CT3B_STATS_OFF;
+	spanel->stats.since = spanel->stats.reset_ts = ktime_get();
+	ct3_prewarm_init(ctx, &spanel->prewarm);
+
+	kthread_init_work(&spanel->enable_work, ct3b_enable_work);
+	init_completion(&spanel->enable_done);
+	complete_all(&spanel->enable_done);
+	spanel->enable_worker = kthread_create_worker(0, "ct3b_enable");
+	if (IS_ERR(spanel->enable_worker)) {
+		dev_warn(&dsi->dev, "failed to create enable worker, enable synchronously\n");
+		spanel->enable_worker = NULL;
+	} else {
+		sched_set_fifo(spanel->enable_worker->task);
+		ret = devm_add_action_or_reset(&dsi->dev, ct3b_destroy_enable_worker,
+					       spanel->enable_worker);
+		if (ret)
+			return ret;
+	}
 	clear_bit(FEAT_ZA, ctx->hw_status.feat);
 
-	ctx->thermal->tz = thermal_zone_device_register("inner_brightness",
-				0, 0, spanel, &spanel_tzd_ops, NULL, 0, 0);
-	if (IS_ERR(ctx->thermal->tz))
-		dev_err(ctx->dev, "failed to register inner"
-			" display thermal zone: %ld", PTR_ERR(ctx->thermal->tz));
-
-	ret = thermal_zone_device_enable(ctx->thermal->tz);
-	if (ret) {
-		dev_err(ctx->dev, "failed to enable inner"
-					" display thermal zone ret=%d", ret);
-		thermal_zone_device_unregister(ctx->thermal->tz);
+	ct3b_load_handoff_compensation(&dsi->dev, spanel);
+	init_completion(&spanel->probe_done);
+	INIT_WORK(&spanel->probe_work, ct3b_probe_work);
+
+	ret = gs_dsi_panel_common_init(dsi, ctx);
+	if (ret)
+		return ret;
+
+	if (of_property_read_bool(dsi->dev.of_node, "google,te-phase-lock")) {
+		spanel->te_sync.ctx = ctx;
+		spanel->te_sync.te = &spanel->te;
+		spanel->te_sync.role = CT3_TE_SYNC_LEADER;
+		spanel->te_sync.apply = ct3b_te_sync_apply;
+		ret = ct3_te_sync_register(&dsi->dev, &spanel->te_sync);
+		if (ret)
+			dev_warn(&dsi->dev, "TE phase lock unavailable (%d)\n", ret);
 	}
 
-	return gs_dsi_panel_common_init(dsi, ctx);
+	ret = devm_add_action_or_reset(&dsi->dev, ct3b_cancel_probe_work, spanel);
+	if (ret)
+		return ret;
+	queue_work(system_unbound_wq, &spanel->probe_work);
+
+	return 0;
+}
+
+/*
+ * Workers that power the panel or take mode_lock must be stopped before the
+ * common remove tears the panel down, devm actions would only run after it.
+ */
+static void ct3b_panel_remove(struct mipi_dsi_device *dsi)
+{
+	struct gs_panel *ctx = mipi_dsi_get_drvdata(dsi);
+	struct ct3b_panel *spanel = to_spanel(ctx);
+
+	/* the probe work registers the input handlers */
+	ct3b_cancel_probe_work(spanel);
+	ct3b_touch_boost_remove(spanel);
+	ct3_prewarm_remove(&spanel->prewarm);
+	ct3_bl_snapshot_remove(&spanel->bl_snapshot);
+	cancel_delayed_work_sync(&spanel->aod_work);
+
+	gs_dsi_panel_common_remove(dsi);
 }
 
 static const struct drm_panel_funcs ct3b_drm_funcs = {
 	.disable = ct3b_disable,
-	.unprepare = gs_panel_unprepare,
-	.prepare = gs_panel_prepare,
+	.unprepare = ct3b_unprepare,
+	.prepare = ct3b_prepare,
 	.enable = ct3b_enable,
 	.get_modes = gs_panel_get_modes,
 	.debugfs_init = ct3b_debugfs_init,
@@ -2074,6 +3323,31 @@ static struct gs_panel_brightness_desc ct3b_brightness_desc = {
 
 static int ct3b_panel_config(struct gs_panel *ctx)
 {
+	struct ct3b_panel *spanel = to_spanel(ctx);
+
+	/* resolve the revision dependent payloads once panel_rev is known */
+	if (ctx->panel_rev < PANEL_REV_EVT1_1)
+		spanel->rev_ops = &ct3b_rev_ops_evt1;
+	else if (ctx->panel_rev < PANEL_REV_DVT1)
+		spanel->rev_ops = &ct3b_rev_ops_evt1_1;
+	else
+		spanel->rev_ops = &ct3b_rev_ops_dvt1;
+
+	if (ctx->panel_rev > PANEL_REV_EVT1_1) {
+		spanel->elvss_hbm2 = &ct3b_elvss_hbm2;
+		spanel->elvss_normal = &ct3b_elvss_normal;
+	} else {
+		spanel->elvss_hbm2 = NULL;
+		spanel->elvss_normal = NULL;
+	}
+
+	if (ctx->panel_rev >= PANEL_REV_EVT1_1)
+		ct3_dbv_zone_table_init(ctx->dev, &spanel->dbv_zones, ct3b_dbv_zones,
+					ARRAY_SIZE(ct3b_dbv_zones), CT3B_DBV_MAX);
+	else
+		spanel->dbv_zones.num_zones = 0;
+	spanel->dbv_range = CT3_DBV_ZONE_NONE;
+
 	/* b/300383405 Currently, we can't support multiple
 	 *  displays in `display_layout_configuration.xml`.
 	 */
@@ -2087,7 +3361,7 @@ static const struct gs_panel_funcs ct3b_gs_funcs = {
 	.set_brightness = ct3b_set_brightness,
 	.set_lp_mode = ct3b_set_lp_mode,
 	.set_nolp_mode = ct3b_set_nolp_mode,
-	.set_binned_lp = gs_panel_set_binned_lp_helper,
+	.set_binned_lp = ct3b_set_binned_lp,
 	.set_hbm_mode = ct3b_set_hbm_mode,
 	.update_te2 = ct3b_update_te2,
 	.commit_done = ct3b_commit_done,
@@ -2149,7 +3423,7 @@ MODULE_DEVICE_TABLE(of, gs_panel_of_match);
 
 static struct mipi_dsi_driver gs_panel_driver = {
 	.probe = ct3b_panel_probe,
-	.remove = gs_dsi_panel_common_remove,
+	.remove = ct3b_panel_remove,
 	.driver = {
 		.name = "panel-gs-ct3b",
 		.of_match_table = gs_panel_of_match,
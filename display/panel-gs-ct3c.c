@@ -13,6 +13,8 @@
 #include "gs_panel/gs_panel.h"
 #include "gs_panel/gs_panel_funcs_defaults.h"
 
+#include "panel-gs-ct3.h"
+
 /* DSC1.1 SCR V4 */
 static const struct drm_dsc_config pps_config = {
 	.line_buf_depth = 9,
@@ -173,6 +175,127 @@ static const struct gs_dsi_cmd ct3c_init_cmds[] = {
 };
 static DEFINE_GS_CMDSET(ct3c_init);
 
+/* register followed by the longest parameter list, the 0x65 EM off table */
+#define CT3C_FREQ_REG_MAX_LEN 33
+#define CT3C_FREQ_NUM_REGS 16
+
+/**
+ * struct ct3c_freq_reg - value of one register written on refresh rate switch
+ */
+struct ct3c_freq_reg {
+	/** @ofs: parameter offset selected through 0xB0 */
+	u16 ofs;
+	/** @len: number of valid bytes in @data */
+	u8 len;
+	/** @data: register followed by its parameters */
+	u8 data[CT3C_FREQ_REG_MAX_LEN];
+};
+
+#define CT3C_FREQ_REG(o, seq...) {			\
+	.ofs = o,					\
+	.len = sizeof((const u8[]){ seq }),		\
+	.data = { seq },				\
+}
+
+/**
+ * struct ct3c_freq_set - registers describing one refresh rate setting
+ *
+ * Entries of all sets must either address the same (offset, register) or not
+ * overlap, so that each entry can be compared against the last written value.
+ */
+struct ct3c_freq_set {
+	/** @regs: register values */
+	const struct ct3c_freq_reg *regs;
+	/** @num_regs: number of entries in @regs */
+	unsigned int num_regs;
+};
+
+#define DEFINE_CT3C_FREQ_SET(name) \
+	static const struct ct3c_freq_set name = { name##_regs, ARRAY_SIZE(name##_regs) }
+
+/* PROTO1, 60Hz NS */
+static const struct ct3c_freq_reg ct3c_proto_60ns_regs[] = {
+	CT3C_FREQ_REG(0x027, 0xF2, 0x82),
+	CT3C_FREQ_REG(0x000, 0x60, 0x00),
+	CT3C_FREQ_REG(0x00E, 0xF2, 0x00, 0x0C),
+	CT3C_FREQ_REG(0x04C, 0xF6, 0x21, 0x0E),
+	CT3C_FREQ_REG(0x088, 0xCB, 0x14, 0x13),
+	CT3C_FREQ_REG(0x08E, 0xCB, 0x14, 0x13),
+	CT3C_FREQ_REG(0x0A6, 0xCB, 0x03, 0x0A, 0x0F, 0x11),
+	CT3C_FREQ_REG(0x0BF, 0xCB, 0x06, 0x33, 0xF8, 0x06, 0x47, 0xD8, 0x06, 0x33, 0xD8,
+		      0x06, 0x47),
+	CT3C_FREQ_REG(0x1FD, 0xCB, 0x1B, 0x1B),
+};
+DEFINE_CT3C_FREQ_SET(ct3c_proto_60ns);
+
+/* PROTO1, 60Hz HS */
+static const struct ct3c_freq_reg ct3c_proto_60hs_regs[] = {
+	CT3C_FREQ_REG(0x027, 0xF2, 0x02),
+	CT3C_FREQ_REG(0x000, 0x60, 0x08),
+	CT3C_FREQ_REG(0x007, 0xF2, 0x09, 0x9C),
+	CT3C_FREQ_REG(0x04C, 0xF6, 0x43, 0x1C),
+	CT3C_FREQ_REG(0x088, 0xCB, 0x27, 0x26),
+	CT3C_FREQ_REG(0x08E, 0xCB, 0x27, 0x26),
+	CT3C_FREQ_REG(0x0A6, 0xCB, 0x07, 0x14, 0x20, 0x22),
+	CT3C_FREQ_REG(0x0BF, 0xCB, 0x0B, 0x19, 0xF8, 0x0B, 0x8D, 0xD8, 0x0B, 0x19, 0xD8,
+		      0x0B, 0x8D),
+	CT3C_FREQ_REG(0x1FD, 0xCB, 0x36, 0x36),
+};
+DEFINE_CT3C_FREQ_SET(ct3c_proto_60hs);
+
+/* PROTO1, 120Hz HS */
+static const struct ct3c_freq_reg ct3c_proto_120hs_regs[] = {
+	CT3C_FREQ_REG(0x027, 0xF2, 0x02),
+	CT3C_FREQ_REG(0x000, 0x60, 0x00),
+	CT3C_FREQ_REG(0x007, 0xF2, 0x00, 0x0C),
+	CT3C_FREQ_REG(0x04C, 0xF6, 0x43, 0x1C),
+	CT3C_FREQ_REG(0x088, 0xCB, 0x27, 0x26),
+	CT3C_FREQ_REG(0x08E, 0xCB, 0x27, 0x26),
+	CT3C_FREQ_REG(0x0A6, 0xCB, 0x07, 0x14, 0x20, 0x22),
+	CT3C_FREQ_REG(0x0BF, 0xCB, 0x0B, 0x19, 0xF8, 0x0B, 0x8D, 0xD8, 0x0B, 0x19, 0xD8,
+		      0x0B, 0x8D),
+	CT3C_FREQ_REG(0x1FD, 0xCB, 0x36, 0x36),
+};
+DEFINE_CT3C_FREQ_SET(ct3c_proto_120hs);
+
+/* EVT1, 60Hz: EM off, gamma, frequency and porch */
+static const struct ct3c_freq_reg ct3c_evt_60_regs[] = {
+	CT3C_FREQ_REG(0x1D4, 0x65, 0x13, 0x20, 0x11, 0x38, 0x11, 0x38, 0x11, 0x38,
+		      0x11, 0x38, 0x10, 0x1D, 0x0E, 0x9B, 0x0D, 0x18,
+		      0x0B, 0x94, 0x0A, 0x15, 0x08, 0x97, 0x07, 0x15,
+		      0x02, 0x90, 0x02, 0x90, 0x01, 0x48, 0x01, 0x48),
+	CT3C_FREQ_REG(0x02A, 0x6A, 0x00, 0x00, 0x00),
+	CT3C_FREQ_REG(0x000, 0x60, 0x00, 0x00),
+	CT3C_FREQ_REG(0x00E, 0xF2, 0x09, 0x9C),
+};
+DEFINE_CT3C_FREQ_SET(ct3c_evt_60);
+
+/* EVT1, 120Hz: EM off, gamma, frequency and porch */
+static const struct ct3c_freq_reg ct3c_evt_120_regs[] = {
+	CT3C_FREQ_REG(0x1B4, 0x65, 0x09, 0x90, 0x08, 0x9C, 0x08, 0x9C, 0x08, 0x9C,
+		      0x08, 0x9C, 0x08, 0x0E, 0x07, 0x4D, 0x06, 0x8C,
+		      0x05, 0xCA, 0x05, 0x0B, 0x04, 0x4C, 0x03, 0x8A,
+		      0x01, 0x48, 0x01, 0x48, 0x00, 0xA4, 0x00, 0xA4),
+	CT3C_FREQ_REG(0x02A, 0x6A, 0x00, 0x00, 0x00),
+	CT3C_FREQ_REG(0x000, 0x60, 0x08, 0x00),
+	CT3C_FREQ_REG(0x007, 0xF2, 0x00, 0x0C),
+};
+DEFINE_CT3C_FREQ_SET(ct3c_evt_120);
+
+/**
+ * struct ct3c_rev_ops - behaviour that differs between panel revisions
+ */
+struct ct3c_rev_ops {
+	/** @change_frequency: writes the registers for a new refresh rate */
+	void (*change_frequency)(struct gs_panel *ctx, const struct gs_panel_mode *pmode);
+	/** @set_op_hz: the revision can switch between 60Hz and 120Hz operation */
+	bool set_op_hz;
+	/** @fgz_legacy: FGZ mode uses the proto register layout at offset 0x118 */
+	bool fgz_legacy;
+	/** @fgz_on: FGZ mode on (IRC off) setting at offset 0x122 */
+	u8 fgz_on[5];
+};
+
 /**
  * struct ct3c_panel - panel specific runtime info
  *
@@ -187,9 +310,83 @@ struct ct3c_panel {
 	 *		  panel can recover to normal mode after entering pixel-off state.
 	 */
 	bool is_pixel_off;
+	/** @num_freq_regs: number of valid entries in @freq_regs */
+	unsigned int num_freq_regs;
+	/** @freq_regs: last written values of the refresh rate registers */
+	struct ct3c_freq_reg freq_regs[CT3C_FREQ_NUM_REGS];
+	/** @rev_ops: revision specific behaviour, resolved once panel_rev is known */
+	const struct ct3c_rev_ops *rev_ops;
 };
 #define to_spanel(ctx) container_of(ctx, struct ct3c_panel, base)
 
+static void ct3c_freq_regs_invalidate(struct gs_panel *ctx)
+{
+	to_spanel(ctx)->num_freq_regs = 0;
+}
+
+static struct ct3c_freq_reg *ct3c_freq_reg_lookup(struct ct3c_panel *spanel,
+						  const struct ct3c_freq_reg *reg)
+{
+	unsigned int i;
+
+	for (i = 0; i < spanel->num_freq_regs; i++) {
+		struct ct3c_freq_reg *r = &spanel->freq_regs[i];
+
+		if (r->ofs == reg->ofs && r->data[0] == reg->data[0])
+			return r;
+	}
+
+	if (spanel->num_freq_regs == CT3C_FREQ_NUM_REGS)
+		return NULL;
+
+	spanel->freq_regs[spanel->num_freq_regs].len = 0;
+	return &spanel->freq_regs[spanel->num_freq_regs++];
+}
+
+/**
+ * ct3c_queue_freq_set - queue the registers of a refresh rate setting
+ * @ctx: gs_panel struct
+ * @set: refresh rate setting
+ *
+ * Only the parameters which differ from the value last written to each
+ * register are sent, addressed through 0xB0. Unchanged registers are skipped
+ * altogether. Test key and LTPS update are left to the caller.
+ */
+static void ct3c_queue_freq_set(struct gs_panel *ctx, const struct ct3c_freq_set *set)
+{
+	struct ct3c_panel *spanel = to_spanel(ctx);
+	struct mipi_dsi_device *dsi = to_mipi_dsi_device(ctx->dev);
+	struct device *dev = ctx->dev;
+	unsigned int i;
+
+	for (i = 0; i < set->num_regs; i++) {
+		const struct ct3c_freq_reg *reg = &set->regs[i];
+		struct ct3c_freq_reg *cached = ct3c_freq_reg_lookup(spanel, reg);
+		u8 first = 1, last = reg->len - 1;
+		u8 buf[CT3C_FREQ_REG_MAX_LEN];
+		u16 ofs;
+
+		if (cached && cached->len == reg->len) {
+			while (first <= last && cached->data[first] == reg->data[first])
+				first++;
+			if (first > last)
+				continue;
+			while (cached->data[last] == reg->data[last])
+				last--;
+		}
+
+		ofs = reg->ofs + first - 1;
+		if (ofs)
+			GS_DCS_BUF_ADD_CMD(dev, 0xB0, ofs >> 8, ofs & 0xFF, reg->data[0]);
+		buf[0] = reg->data[0];
+		memcpy(&buf[1], &reg->data[first], last - first + 1);
+		gs_dsi_dcs_write_buffer(dsi, buf, last - first + 2, GS_DSI_MSG_QUEUE);
+
+		if (cached)
+			*cached = *reg;
+	}
+}
+
 static void ct3c_proto_change_frequency(struct gs_panel *ctx, const struct gs_panel_mode *pmode)
 {
 	struct device *dev = ctx->dev;
@@ -210,54 +407,17 @@ static void ct3c_proto_change_frequency(struct gs_panel *ctx, const struct gs_pa
 	}
 
 	GS_DCS_BUF_ADD_CMDLIST(dev, test_key_enable);
-	GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x00, 0x27, 0xF2);
-
-	if (ctx->op_hz == 60) {
-		GS_DCS_BUF_ADD_CMD(dev, 0xF2, 0x82);
-		GS_DCS_BUF_ADD_CMD(dev, 0x60, 0x00);
-		GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x00, 0x0E, 0xF2);
-		GS_DCS_BUF_ADD_CMD(dev, 0xF2, 0x00, 0x0C);
-		GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x00, 0x4C, 0xF6);
-		GS_DCS_BUF_ADD_CMD(dev, 0xF6, 0x21, 0x0E);
-		GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x00, 0x88, 0xCB);
-		GS_DCS_BUF_ADD_CMD(dev, 0xCB, 0x14, 0x13);
-		GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x00, 0x8E, 0xCB);
-		GS_DCS_BUF_ADD_CMD(dev, 0xCB, 0x14, 0x13);
-		GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x00, 0xA6, 0xCB);
-		GS_DCS_BUF_ADD_CMD(dev, 0xCB, 0x03, 0x0A, 0x0F, 0x11);
-		GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x00, 0xBF, 0xCB);
-		GS_DCS_BUF_ADD_CMD(dev,
-			0xCB, 0x06, 0x33, 0xF8, 0x06, 0x47, 0xD8, 0x06, 0x33, 0xD8, 0x06, 0x47);
-		GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x01, 0xFD, 0xCB);
-		GS_DCS_BUF_ADD_CMD(dev, 0xCB, 0x1B, 0x1B);
-	} else {
-		GS_DCS_BUF_ADD_CMD(dev, 0xF2, 0x02);
-		GS_DCS_BUF_ADD_CMD(dev, 0x60, (vrefresh == 120) ? 0x00 : 0x08);
-		GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x00, 0x07, 0xF2);
-		if (vrefresh == 120) {
-			GS_DCS_BUF_ADD_CMD(dev, 0xF2, 0x00, 0x0C);
-		} else {
-			GS_DCS_BUF_ADD_CMD(dev, 0xF2, 0x09, 0x9C);
-		}
-		GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x00, 0x4C, 0xF6);
-		GS_DCS_BUF_ADD_CMD(dev, 0xF6, 0x43, 0x1C);
-		GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x00, 0x88, 0xCB);
-		GS_DCS_BUF_ADD_CMD(dev, 0xCB, 0x27, 0x26);
-		GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x00, 0x8E, 0xCB);
-		GS_DCS_BUF_ADD_CMD(dev, 0xCB, 0x27, 0x26);
-		GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x00, 0xA6, 0xCB);
-		GS_DCS_BUF_ADD_CMD(dev, 0xCB, 0x07, 0x14, 0x20, 0x22);
-		GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x00, 0xBF, 0xCB);
-		GS_DCS_BUF_ADD_CMD(dev,
-			0xCB, 0x0B, 0x19, 0xF8, 0x0B, 0x8D, 0xD8, 0x0B, 0x19, 0xD8, 0x0B, 0x8D);
-		GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x01, 0xFD, 0xCB);
-		GS_DCS_BUF_ADD_CMD(dev, 0xCB, 0x36, 0x36);
-	}
-
+	if (ctx->op_hz == 60)
+		ct3c_queue_freq_set(ctx, &ct3c_proto_60ns);
+	else if (vrefresh == 120)
+		ct3c_queue_freq_set(ctx, &ct3c_proto_120hs);
+	else
+		ct3c_queue_freq_set(ctx, &ct3c_proto_60hs);
 	GS_DCS_BUF_ADD_CMDLIST(dev, ltps_update);
 	GS_DCS_BUF_ADD_CMDLIST_AND_FLUSH(dev, test_key_disable);
 
-	dev_info(dev, "%s: change to %uHz, op_hz=%u\n", __func__, vrefresh, ctx->op_hz);
+	dev_dbg(dev, "%s: change to %uHz, op_hz=%u\n", __func__, vrefresh, ctx->op_hz);
+	ct3_log(ctx, CT3_LOG_FREQ, vrefresh, ctx->op_hz);
 }
 
 static void ct3c_freq_change_command(struct gs_panel *ctx, const u32 vrefresh)
@@ -265,37 +425,8 @@ static void ct3c_freq_change_command(struct gs_panel *ctx, const u32 vrefresh)
 	struct device *dev = ctx->dev;
 
 	GS_DCS_BUF_ADD_CMDLIST(dev, test_key_enable);
-
-	/* EM Off Change */
-	if (vrefresh == 60) {
-		GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x01, 0xD4, 0x65);
-		GS_DCS_BUF_ADD_CMD(dev, 0x65, 0x13, 0x20, 0x11, 0x38, 0x11, 0x38, 0x11, 0x38,
-			0x11, 0x38, 0x10, 0x1D, 0x0E, 0x9B, 0x0D, 0x18,
-			0x0B, 0x94, 0x0A, 0x15, 0x08, 0x97, 0x07, 0x15,
-			0x02, 0x90, 0x02, 0x90, 0x01, 0x48, 0x01, 0x48);
-	} else {
-		GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x01, 0xB4, 0x65);
-		GS_DCS_BUF_ADD_CMD(dev, 0x65, 0x09, 0x90, 0x08, 0x9C, 0x08, 0x9C, 0x08, 0x9C,
-			0x08, 0x9C, 0x08, 0x0E, 0x07, 0x4D, 0x06, 0x8C,
-			0x05, 0xCA, 0x05, 0x0B, 0x04, 0x4C, 0x03, 0x8A,
-			0x01, 0x48, 0x01, 0x48, 0x00, 0xA4, 0x00, 0xA4);
-	}
-	GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x00, 0x2A, 0x6A);
-
-	/* Gamma change */
-	GS_DCS_BUF_ADD_CMD(dev, 0x6A, 0x00, 0x00, 0x00);
-
-	/* Frequency and Porch Change */
-	if (vrefresh == 60) {
-		GS_DCS_BUF_ADD_CMD(dev, 0x60, 0x00, 0x00);
-		GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x00, 0x0E, 0xF2);
-		GS_DCS_BUF_ADD_CMD(dev, 0xF2, 0x09, 0x9C);
-	} else {
-		GS_DCS_BUF_ADD_CMD(dev, 0x60, 0x08, 0x00);
-		GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x00, 0x07, 0xF2);
-		GS_DCS_BUF_ADD_CMD(dev, 0xF2, 0x00, 0x0C);
-	}
-
+	/* EM off, gamma, frequency and porch change */
+	ct3c_queue_freq_set(ctx, (vrefresh == 60) ? &ct3c_evt_60 : &ct3c_evt_120);
 	GS_DCS_BUF_ADD_CMDLIST(dev, ltps_update);
 	GS_DCS_BUF_ADD_CMDLIST_AND_FLUSH(dev, test_key_disable);
 }
@@ -318,32 +449,52 @@ static void ct3c_evt_change_frequency(struct gs_panel *ctx, const struct gs_pane
 	ct3c_freq_change_command(ctx, vrefresh);
 	ct3c_te_change_command(ctx, vrefresh);
 
-	dev_info(ctx->dev, "%s: change to %uHz\n", __func__, vrefresh);
+	dev_dbg(ctx->dev, "%s: change to %uHz\n", __func__, vrefresh);
+	ct3_log(ctx, CT3_LOG_FREQ, vrefresh, ctx->op_hz);
 	return;
 }
 
-static void ct3c_change_frequency(struct gs_panel *ctx, const struct gs_panel_mode *pmode)
+static void ct3c_dvt_change_frequency(struct gs_panel *ctx, const struct gs_panel_mode *pmode)
 {
 	struct device *dev = ctx->dev;
-
 	u32 vrefresh = drm_mode_vrefresh(&pmode->mode);
 
-	if (ctx->panel_rev == PANEL_REV_PROTO1) {
-		ct3c_proto_change_frequency(ctx, pmode);
-	} else if (ctx->panel_rev == PANEL_REV_EVT1) {
-		ct3c_evt_change_frequency(ctx, pmode);
-	} else {
-		if (!ctx || ((vrefresh != 60) && (vrefresh != 120)))
-			return;
+	if ((vrefresh != 60) && (vrefresh != 120))
+		return;
 
-		GS_DCS_BUF_ADD_CMDLIST(dev, test_key_enable);
-		GS_DCS_BUF_ADD_CMD(dev, 0x60, (vrefresh == 120) ? 0x08 : 0x00);
-		GS_DCS_BUF_ADD_CMDLIST(dev, ltps_update);
-		GS_DCS_BUF_ADD_CMDLIST_AND_FLUSH(dev, test_key_disable);
+	GS_DCS_BUF_ADD_CMDLIST(dev, test_key_enable);
+	GS_DCS_BUF_ADD_CMD(dev, 0x60, (vrefresh == 120) ? 0x08 : 0x00);
+	GS_DCS_BUF_ADD_CMDLIST(dev, ltps_update);
+	GS_DCS_BUF_ADD_CMDLIST_AND_FLUSH(dev, test_key_disable);
 
-		dev_info(dev, "%s: change to %uHz\n", __func__, vrefresh);
-		return;
-	}
+	dev_dbg(dev, "%s: change to %uHz\n", __func__, vrefresh);
+	ct3_log(ctx, CT3_LOG_FREQ, vrefresh, ctx->op_hz);
+}
+
+static const struct ct3c_rev_ops ct3c_rev_ops_proto1 = {
+	.change_frequency = ct3c_proto_change_frequency,
+	.set_op_hz = true,
+	.fgz_legacy = true,
+};
+
+static const struct ct3c_rev_ops ct3c_rev_ops_proto1_1 = {
+	.change_frequency = ct3c_dvt_change_frequency,
+	.fgz_on = { 0x68, 0x2D, 0xF1, 0xFF, 0x94 },
+};
+
+static const struct ct3c_rev_ops ct3c_rev_ops_evt1 = {
+	.change_frequency = ct3c_evt_change_frequency,
+	.fgz_on = { 0x68, 0x40, 0x00, 0xFF, 0x9C },
+};
+
+static const struct ct3c_rev_ops ct3c_rev_ops_dvt1 = {
+	.change_frequency = ct3c_dvt_change_frequency,
+	.fgz_on = { 0x68, 0x28, 0xED, 0xFF, 0x94 },
+};
+
+static void ct3c_change_frequency(struct gs_panel *ctx, const struct gs_panel_mode *pmode)
+{
+	to_spanel(ctx)->rev_ops->change_frequency(ctx, pmode);
 }
 
 static int ct3c_set_op_hz(struct gs_panel *ctx, unsigned int hz)
@@ -359,7 +510,7 @@ static int ct3c_set_op_hz(struct gs_panel *ctx, unsigned int hz)
 
 	ctx->op_hz = hz;
 
-	if (ctx->panel_rev == PANEL_REV_PROTO1) {
+	if (to_spanel(ctx)->rev_ops->set_op_hz) {
 		ct3c_change_frequency(ctx, pmode);
 		dev_info(ctx->dev, "set op_hz at %u\n", hz);
 	} else {
@@ -444,7 +595,7 @@ static void ct3c_set_hbm_mode(struct gs_panel *ctx, enum gs_hbm_mode mode)
 
 	GS_DCS_BUF_ADD_CMDLIST(dev, test_key_enable);
 
-	if (ctx->panel_rev == PANEL_REV_PROTO1) {
+	if (to_spanel(ctx)->rev_ops->fgz_legacy) {
 		GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x01, 0x18, 0x68);
 		/* FGZ mode enable (IRC off) / FLAT gamma (default, IRC on)  */
 		GS_DCS_BUF_ADD_CMD(dev, 0x68, GS_IS_HBM_ON_IRC_OFF(ctx->hbm_mode) ? 0x82 : 0x00);
@@ -454,16 +605,9 @@ static void ct3c_set_hbm_mode(struct gs_panel *ctx, enum gs_hbm_mode mode)
 			0x00, 0x0A, 0xD5, 0xFF, 0x94, 0x00, 0x00); /* FGZ mode */
 	} else {
 		GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x01, 0x22, 0x68);
-		if (GS_IS_HBM_ON_IRC_OFF(ctx->hbm_mode)) {
-			/* FGZ Mode ON */
-			if (ctx->panel_rev == PANEL_REV_PROTO1_1) {
-				GS_DCS_BUF_ADD_CMD(dev, 0x68, 0x2D, 0xF1, 0xFF, 0x94);
-			} else if (ctx->panel_rev == PANEL_REV_EVT1) {
-				GS_DCS_BUF_ADD_CMD(dev, 0x68, 0x40, 0x00, 0xFF, 0x9C);
-			} else {
-				GS_DCS_BUF_ADD_CMD(dev, 0x68, 0x28, 0xED, 0xFF, 0x94);
-			}
-		} else
+		if (GS_IS_HBM_ON_IRC_OFF(ctx->hbm_mode))
+			GS_DCS_BUF_ADD_CMDLIST(dev, to_spanel(ctx)->rev_ops->fgz_on); /* FGZ Mode ON */
+		else
 			GS_DCS_BUF_ADD_CMD(dev, 0x68, 0x00, 0x00, 0xFF, 0x90); /* FGZ Mode OFF */
 	}
 
@@ -504,6 +648,8 @@ static void ct3c_debugfs_init(struct drm_panel *panel, struct dentry *root)
 	if (!panel_root)
 		return;
 
+	ct3_dsi_prof_debugfs_init(panel_root);
+
 	csroot = debugfs_lookup("cmdsets", panel_root);
 	if (!csroot) {
 		goto panel_out;
@@ -530,6 +676,16 @@ static void ct3c_get_panel_rev(struct gs_panel *ctx, u32 id)
 		rev--;
 
 	gs_panel_get_panel_rev(ctx, rev);
+
+	/* resolve once, so that commit time code doesn't have to test panel_rev */
+	if (ctx->panel_rev == PANEL_REV_PROTO1)
+		to_spanel(ctx)->rev_ops = &ct3c_rev_ops_proto1;
+	else if (ctx->panel_rev == PANEL_REV_PROTO1_1)
+		to_spanel(ctx)->rev_ops = &ct3c_rev_ops_proto1_1;
+	else if (ctx->panel_rev == PANEL_REV_EVT1)
+		to_spanel(ctx)->rev_ops = &ct3c_rev_ops_evt1;
+	else
+		to_spanel(ctx)->rev_ops = &ct3c_rev_ops_dvt1;
 }
 
 static void ct3c_set_lp_mode(struct gs_panel *ctx,
@@ -537,6 +693,8 @@ static void ct3c_set_lp_mode(struct gs_panel *ctx,
 {
 	gs_panel_set_lp_mode_helper(ctx, pmode);
 	ct3c_te_change_command(ctx, drm_mode_vrefresh(&ctx->current_mode->mode));
+	/* LP commands may touch frequency registers, rewrite them in full on exit */
+	ct3c_freq_regs_invalidate(ctx);
 }
 
 static void ct3c_set_nolp_mode(struct gs_panel *ctx, const struct gs_panel_mode *pmode)
@@ -598,6 +756,7 @@ static int ct3c_enable(struct drm_panel *panel)
 	dev_info(dev, "%s\n", __func__);
 
 	gs_panel_reset_helper(ctx);
+	ct3c_freq_regs_invalidate(ctx);
 
 	/* sleep out */
 	GS_DCS_WRITE_DELAY_CMD(dev, 120, MIPI_DCS_EXIT_SLEEP_MODE);
@@ -644,6 +803,8 @@ static int ct3c_panel_probe(struct mipi_dsi_device *dsi)
 	*/
 	spanel->base.op_hz = 120;
 	spanel->is_pixel_off = false;
+	/* until the revision is known */
+	spanel->rev_ops = &ct3c_rev_ops_dvt1;
 
 	return gs_dsi_panel_common_init(dsi, &spanel->base);
 }
@@ -23,8 +23,9 @@
 #include "gs_panel/gs_panel.h"
 #include "gs_panel/gs_panel_funcs_defaults.h"
 
+#include "panel-gs-ct3.h"
+
 #define CT3D_DDIC_ID_LEN 8
-#define CT3D_DIMMING_FRAME 32
 
 #define WIDTH_MM 64
 #define HEIGHT_MM 145
@@ -34,6 +35,41 @@
 
 #define PROJECT "CT3D"
 
+/**
+ * enum ct3d_dbv_range - index of the DBV zones in ct3d_dbv_zones
+ * @DBV_NORMAL: normal and hbm brightness
+ * @DBV_HBM2: hbm2 mode, only used while IRC is off
+ * @DBV_RANGE_MAX: number of zones
+ */
+enum ct3d_dbv_range {
+	DBV_NORMAL,
+	DBV_HBM2,
+	DBV_RANGE_MAX,
+};
+
+/* ACD configuration indexes used in ct3d_dbv_zones */
+#define CT3D_ACD_OFF 0
+#define CT3D_ACD_LEVEL3 1
+
+/*
+ * The HBM2 threshold is replaced with the maximum hbm level of the brightness
+ * configuration in ct3d_panel_config(), before "google,dbv-zone-thresholds" is
+ * applied.
+ */
+static const struct ct3_dbv_zone ct3d_dbv_zones[DBV_RANGE_MAX] = {
+	[DBV_NORMAL] = {
+		.min_dbv = 0x0001,
+		.cfg = { [CT3_ZONE_REG_ACD] = CT3D_ACD_OFF },
+	},
+	[DBV_HBM2] = {
+		.min_dbv = 0x0F63,
+		.flags = CT3_DBV_ZONE_EXACT,
+		.cfg = { [CT3_ZONE_REG_ACD] = CT3D_ACD_LEVEL3 },
+	},
+};
+
+#define CT3D_DBV_MAX 0x0FFF
+
 /**
  * struct ct3d_panel - panel specific runtime info
  *
@@ -45,6 +81,16 @@ struct ct3d_panel {
 	struct gs_panel base;
 	/** @is_hbm2_enabled: indicates panel is running in HBM mode 2 */
 	bool is_hbm2_enabled;
+	/** @dbv_zones: dbv zones of the current panel revision */
+	struct ct3_dbv_zone_table dbv_zones;
+	/** @ffc: DSI clock hopping state */
+	struct ct3_ffc ffc;
+	/** @dimming: brightness ramp length */
+	struct ct3_dimming dimming;
+	/** @te: TE interrupt the phase to the inner display is measured with */
+	struct ct3_te te;
+	/** @te_sync: TE phase lock to the inner display */
+	struct ct3_te_sync te_sync;
 };
 
 #define to_spanel(ctx) container_of(ctx, struct ct3d_panel, base)
@@ -226,10 +272,11 @@ static DEFINE_GS_CMDSET(ct3d_init);
 
 static void ct3d_update_te2(struct gs_panel *ctx)
 {
+	const struct gs_panel_mode *pmode = ctx->current_mode;
 	struct gs_panel_te2_timing timing;
 	struct device *dev = ctx->dev;
 	u8 width = 0x2D; /* default width */
-	u32 rising = 0, falling;
+	u32 rising = 0, falling, line, advance = 0;
 	int ret;
 
 	ret = gs_panel_get_current_mode_te2(ctx, &timing);
@@ -247,12 +294,25 @@ static void ct3d_update_te2(struct gs_panel *ctx)
 		return;
 	}
 
-	dev_dbg(dev, "TE2 updated: rising= 0x%x, width= 0x%x", rising, width);
+	/* fire TE ahead of the frame start so the DPU fetch trails the inner display's */
+	if (pmode && !pmode->gs_mode.is_lp_mode)
+		advance = ct3_te_sync_advance_lines(&to_spanel(ctx)->te_sync, &pmode->mode);
+	line = advance ? (pmode->mode.vtotal - advance + rising) % pmode->mode.vtotal : rising;
 
-	GS_DCS_BUF_ADD_CMD(dev, MIPI_DCS_SET_TEAR_SCANLINE, 0x00, rising);
+	dev_dbg(dev, "TE2 updated: rising= 0x%x, width= 0x%x, line= 0x%x", rising, width, line);
+
+	GS_DCS_BUF_ADD_CMD(dev, MIPI_DCS_SET_TEAR_SCANLINE, line >> 8, line & 0xff);
 	GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, MIPI_DCS_SET_TEAR_ON, 0x00, width);
 }
 
+static void ct3d_te_sync_apply(struct gs_panel *ctx)
+{
+	mutex_lock(&ctx->mode_lock);
+	if (gs_is_panel_active(ctx))
+		ct3d_update_te2(ctx);
+	mutex_unlock(&ctx->mode_lock);
+}
+
 static void ct3d_update_irc(struct gs_panel *ctx,
 				const enum gs_hbm_mode hbm_mode,
 				const int vrefresh)
@@ -324,6 +384,21 @@ static void ct3d_update_irc(struct gs_panel *ctx,
 	GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0x00);
 }
 
+static void ct3d_dimming_frame_setting(struct gs_panel *ctx, const struct gs_panel_mode *pmode)
+{
+	struct ct3_dimming *dim = &to_spanel(ctx)->dimming;
+	struct device *dev = ctx->dev;
+
+	if (!ct3_dimming_update(dim, drm_mode_vrefresh(&pmode->mode)))
+		return;
+
+	GS_DCS_BUF_ADD_CMD(dev, 0xF0, 0x55, 0xAA, 0x52, 0x08, 0x00);
+	GS_DCS_BUF_ADD_CMD(dev, 0xB2, 0x19);
+	GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x05);
+	GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0xB2, dim->frames, dim->frames);
+	dev_dbg(dev, "%s: %u frames at %uHz\n", __func__, dim->frames, dim->vrefresh);
+}
+
 static void ct3d_change_frequency(struct gs_panel *ctx,
 				    const struct gs_panel_mode *pmode)
 {
@@ -333,6 +408,8 @@ static void ct3d_change_frequency(struct gs_panel *ctx,
 	if (vrefresh != 60 && vrefresh != 120)
 		return;
 
+	ct3d_dimming_frame_setting(ctx, pmode);
+
 	if (!GS_IS_HBM_ON(ctx->hbm_mode)) {
 		if (vrefresh == 120) {
 			GS_DCS_BUF_ADD_CMD(dev, 0x2F, 0x00);
@@ -346,10 +423,18 @@ static void ct3d_change_frequency(struct gs_panel *ctx,
 	} else {
 		ct3d_update_irc(ctx, ctx->hbm_mode, vrefresh);
 	}
+	ct3_te_sync_update(&to_spanel(ctx)->te_sync);
 
 	dev_dbg(dev, "%s: change to %uhz\n", __func__, vrefresh);
 }
 
+static void ct3d_set_lp_mode(struct gs_panel *ctx, const struct gs_panel_mode *pmode)
+{
+	gs_panel_set_lp_mode_helper(ctx, pmode);
+	/* AOD runs at its own rate, the TE goes back to free running */
+	ct3_te_sync_update(&to_spanel(ctx)->te_sync);
+}
+
 static void ct3d_set_dimming(struct gs_panel *ctx,
 				 bool dimming_on)
 {
@@ -396,20 +481,6 @@ static void ct3d_set_nolp_mode(struct gs_panel *ctx,
 	dev_info(dev, "exit LP mode\n");
 }
 
-static void ct3d_dimming_frame_setting(struct gs_panel *ctx, u8 dimming_frame)
-{
-	struct device *dev = ctx->dev;
-
-	/* Fixed time 1 frame */
-	if (!dimming_frame)
-		dimming_frame = 0x01;
-
-	GS_DCS_BUF_ADD_CMD(dev, 0xF0, 0x55, 0xAA, 0x52, 0x08, 0x00);
-	GS_DCS_BUF_ADD_CMD(dev, 0xB2, 0x19);
-	GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x05);
-	GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0xB2, dimming_frame, dimming_frame);
-}
-
 static int ct3d_enable(struct drm_panel *panel)
 {
 	struct gs_panel *ctx = container_of(panel, struct gs_panel, base);
@@ -426,10 +497,9 @@ static int ct3d_enable(struct drm_panel *panel)
 	gs_panel_reset_helper(ctx);
 	gs_panel_send_cmdset(ctx, &ct3d_init_cmdset);
 	ct3d_change_frequency(ctx, pmode);
-	ct3d_dimming_frame_setting(ctx, CT3D_DIMMING_FRAME);
 
 	if (pmode->gs_mode.is_lp_mode)
-		gs_panel_set_lp_mode_helper(ctx, pmode);
+		ct3d_set_lp_mode(ctx, pmode);
 
 	GS_DCS_WRITE_CMD(dev, MIPI_DCS_SET_DISPLAY_ON);
 
@@ -445,11 +515,15 @@ static int ct3d_disable(struct drm_panel *panel)
 	int ret;
 
 	spanel->is_hbm2_enabled = false;
+	/* panel register state gets reset after disabling hardware */
+	spanel->dimming.frames = 0;
 
 	ret = gs_panel_disable(panel);
 	if (ret)
 		return ret;
 
+	ct3_te_sync_update(&spanel->te_sync);
+
 	return 0;
 }
 
@@ -475,6 +549,7 @@ static int ct3d_atomic_check(struct gs_panel *ctx, struct drm_atomic_state *stat
 		drm_mode_vrefresh(&new_crtc_state->mode) == 60)) {
 		struct drm_display_mode *mode = &new_crtc_state->adjusted_mode;
 
+		/* resume and lp exit are modesets already, raising the clock is free */
 		mode->clock = mode->htotal * mode->vtotal * 120 / 1000;
 		if (mode->clock != new_crtc_state->mode.clock) {
 			new_crtc_state->mode_changed = true;
@@ -485,7 +560,11 @@ static int ct3d_atomic_check(struct gs_panel *ctx, struct drm_atomic_state *stat
 				"resume" : "lp exit");
 		}
 	} else if (old_crtc_state->adjusted_mode.clock != old_crtc_state->mode.clock) {
-		/* clock hacked in last commit due to resume or lp exit, undo that */
+		/*
+		 * clock raised on resume or lp exit, undo that. decon only reprograms
+		 * the clock on a modeset, so this costs a second modeset per wake until
+		 * gs_drm can drop the override without one.
+		 */
 		new_crtc_state->mode_changed = true;
 		new_crtc_state->adjusted_mode.clock = new_crtc_state->mode.clock;
 		ctx->gs_connector->needs_commit = false;
@@ -496,60 +575,48 @@ static int ct3d_atomic_check(struct gs_panel *ctx, struct drm_atomic_state *stat
 	return 0;
 }
 
+static const u8 ct3d_ffc_865[] = {
+	0xC3, 0xDD, 0x06, 0x20, 0x0E, 0xFF,
+	0x00, 0x06, 0x20, 0x0E, 0xFF, 0x00,
+	0x04, 0x79, 0x0E, 0x06, 0x12, 0x13,
+	0x04, 0x79, 0x0E, 0x06, 0x12, 0x13,
+	0x04, 0x79, 0x0E, 0x06, 0x12, 0x13,
+	0x04, 0x79, 0x0E, 0x06, 0x12, 0x13,
+	0x04, 0x79, 0x0E, 0x06, 0x12, 0x13,
+};
+
+static const u8 ct3d_ffc_756[] = {
+	0xC3, 0xDD, 0x06, 0x20, 0x0C, 0xFF,
+	0x00, 0x06, 0x20, 0x0C, 0xFF, 0x00,
+	0x04, 0x63, 0x0C, 0x05, 0xD9, 0x10,
+	0x04, 0x63, 0x0C, 0x05, 0xD9, 0x10,
+	0x04, 0x63, 0x0C, 0x05, 0xD9, 0x10,
+	0x04, 0x63, 0x0C, 0x05, 0xD9, 0x10,
+	0x04, 0x63, 0x0C, 0x05, 0xD9, 0x10,
+};
+
+static const struct ct3_ffc_payload ct3d_ffc_payloads[] = {
+	CT3_FFC_PAYLOAD(MIPI_DSI_FREQ_MBPS_DEFAULT, ct3d_ffc_865),
+	CT3_FFC_PAYLOAD(MIPI_DSI_FREQ_MBPS_ALTERNATIVE, ct3d_ffc_756),
+};
+
 static void ct3d_pre_update_ffc(struct gs_panel *ctx)
 {
-	struct device *dev = ctx->dev;
-
 	dev_dbg(ctx->dev, "%s\n", __func__);
 
-	/* FFC off */
-	GS_DCS_BUF_ADD_CMD(dev, 0xF0, 0x55, 0xAA, 0x52, 0x08, 0x01);
-	GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0xC3, 0x00);
+	ct3_ffc_pre_update(ctx, &to_spanel(ctx)->ffc);
 }
 
 static void ct3d_update_ffc(struct gs_panel *ctx, unsigned int hs_clk_mbps)
 {
-	struct device *dev = ctx->dev;
-
-	dev_dbg(ctx->dev, "%s: hs_clk_mbps: current=%d, target=%d\n",
-		__func__, ctx->dsi_hs_clk_mbps, hs_clk_mbps);
-
-	if (hs_clk_mbps != MIPI_DSI_FREQ_MBPS_DEFAULT &&
-	    hs_clk_mbps != MIPI_DSI_FREQ_MBPS_ALTERNATIVE) {
-		dev_warn(ctx->dev, "invalid hs_clk_mbps=%d for FFC\n", hs_clk_mbps);
-	} else if (ctx->dsi_hs_clk_mbps != hs_clk_mbps) {
-		dev_info(ctx->dev, "%s: updating for hs_clk_mbps=%d\n", __func__, hs_clk_mbps);
-		ctx->dsi_hs_clk_mbps = hs_clk_mbps;
-
-		/* Update FFC */
-		GS_DCS_BUF_ADD_CMD(dev, 0xF0, 0x55, 0xAA, 0x52, 0x08, 0x01);
-		if (hs_clk_mbps == MIPI_DSI_FREQ_MBPS_DEFAULT)
-			GS_DCS_BUF_ADD_CMD(dev, 0xC3, 0xDD, 0x06, 0x20, 0x0E, 0xFF,
-						0x00, 0x06, 0x20, 0x0E, 0xFF, 0x00,
-						0x04, 0x79, 0x0E, 0x06, 0x12, 0x13,
-						0x04, 0x79, 0x0E, 0x06, 0x12, 0x13,
-						0x04, 0x79, 0x0E, 0x06, 0x12, 0x13,
-						0x04, 0x79, 0x0E, 0x06, 0x12, 0x13,
-						0x04, 0x79, 0x0E, 0x06, 0x12, 0x13);
-		else /* MIPI_DSI_FREQ_MBPS_ALTERNATIVE */
-			GS_DCS_BUF_ADD_CMD(dev, 0xC3, 0xDD, 0x06, 0x20, 0x0C, 0xFF,
-						0x00, 0x06, 0x20, 0x0C, 0xFF, 0x00,
-						0x04, 0x63, 0x0C, 0x05, 0xD9, 0x10,
-						0x04, 0x63, 0x0C, 0x05, 0xD9, 0x10,
-						0x04, 0x63, 0x0C, 0x05, 0xD9, 0x10,
-						0x04, 0x63, 0x0C, 0x05, 0xD9, 0x10,
-						0x04, 0x63, 0x0C, 0x05, 0xD9, 0x10);
-	}
-
-	/* FFC on */
-	GS_DCS_BUF_ADD_CMD(dev, 0xF0, 0x55, 0xAA, 0x52, 0x08, 0x01);
-	GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0xC3, 0xDD);
+	ct3_ffc_update(ctx, &to_spanel(ctx)->ffc, hs_clk_mbps);
 }
 
 static int ct3d_set_brightness(struct gs_panel *ctx, u16 br)
 {
 	struct device *dev = ctx->dev;
 	struct ct3d_panel *spanel = to_spanel(ctx);
+	int cur, zone;
 
 	if (ctx->current_mode->gs_mode.is_lp_mode) {
 		if (gs_panel_has_func(ctx, set_binned_lp))
@@ -557,31 +624,36 @@ static int ct3d_set_brightness(struct gs_panel *ctx, u16 br)
 		return 0;
 	}
 
-	if (GS_IS_HBM_ON_IRC_OFF(ctx->hbm_mode)
-			&& br == ctx->desc->brightness_desc->brt_capability->hbm.level.max) {
+	cur = spanel->is_hbm2_enabled ? DBV_HBM2 : DBV_NORMAL;
+	zone = ct3_dbv_zone_select(&spanel->dbv_zones, cur, br);
+	/* hbm2 is only allowed while IRC is off */
+	if (zone == CT3_DBV_ZONE_NONE ||
+	    (zone == DBV_HBM2 && !GS_IS_HBM_ON_IRC_OFF(ctx->hbm_mode)))
+		zone = DBV_NORMAL;
 
+	spanel->is_hbm2_enabled = (zone == DBV_HBM2);
+	if (spanel->is_hbm2_enabled)
 		/* set brightness to hbm2 */
-		GS_DCS_BUF_ADD_CMD(dev, MIPI_DCS_SET_DISPLAY_BRIGHTNESS, 0x0F, 0xFF);
-		spanel->is_hbm2_enabled = true;
-
-		/* set ACD Level 3 */
-		GS_DCS_BUF_ADD_CMD(dev, 0x55, 0x04);
-		GS_DCS_BUF_ADD_CMD(dev, 0xF0, 0x55, 0xAA, 0x52, 0x08, 0x00);
-		GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x0C);
-		GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, 0xB0, 0x0E, 0x2C, 0x32);
-		dev_info(ctx->dev, "%s: is HBM2 enabled : %d\n",
-				__func__, spanel->is_hbm2_enabled);
-	} else {
+		br = 0xfff;
 
-		if (spanel->is_hbm2_enabled) {
+	if (ct3_dbv_zone_diff(&spanel->dbv_zones, cur, zone) & BIT(CT3_ZONE_REG_ACD)) {
+		if (spanel->dbv_zones.zones[zone].cfg[CT3_ZONE_REG_ACD] == CT3D_ACD_LEVEL3) {
+			/* set ACD Level 3 */
+			GS_DCS_BUF_ADD_CMD(dev, 0x55, 0x04);
+			GS_DCS_BUF_ADD_CMD(dev, 0xF0, 0x55, 0xAA, 0x52, 0x08, 0x00);
+			GS_DCS_BUF_ADD_CMD(dev, 0x6F, 0x0C);
+			GS_DCS_BUF_ADD_CMD(dev, 0xB0, 0x0E, 0x2C, 0x32);
+		} else {
 			/* set ACD off */
 			GS_DCS_BUF_ADD_CMD(dev, 0x55, 0x00);
-			dev_info(ctx->dev, "%s: is HBM2 enabled: off\n", __func__);
 		}
-		spanel->is_hbm2_enabled = false;
-		GS_DCS_BUF_ADD_CMD_AND_FLUSH(dev, MIPI_DCS_SET_DISPLAY_BRIGHTNESS,
-						br >> 8, br & 0xff);
+		dev_info(ctx->dev, "%s: is HBM2 enabled: %d\n",
+				__func__, spanel->is_hbm2_enabled);
 	}
+
+	/* ACD is flushed together with the DBV */
+	ct3_brightness_commit(ctx, br);
+
 	return 0;
 }
 
@@ -639,6 +711,8 @@ static int ct3d_read_id(struct gs_panel *ctx)
 	ret = mipi_dsi_dcs_read(dsi, 0xF2, buf, CT3D_DDIC_ID_LEN);
 	if (ret != CT3D_DDIC_ID_LEN) {
 		dev_warn(dev, "Unable to read DDIC id (%d)\n", ret);
+		ct3_log(ctx, CT3_LOG_READ_ERR, 0xF2, ret);
+		ct3_log_dump("DDIC id read failed");
 		goto done;
 	} else {
 		ret = 0;
@@ -773,6 +847,8 @@ static void ct3d_debugfs_init(struct drm_panel *panel, struct dentry *root)
 	if (!panel_root)
 		return;
 
+	ct3_dsi_prof_debugfs_init(panel_root);
+
 	csroot = debugfs_lookup("cmdsets", panel_root);
 	if (!csroot)
 		goto panel_out;
@@ -785,19 +861,43 @@ panel_out:
 
 static void ct3d_panel_init(struct gs_panel *ctx)
 {
-	ct3d_dimming_frame_setting(ctx, CT3D_DIMMING_FRAME);
+	/* re-init panel to decouple bootloader settings */
+	to_spanel(ctx)->dimming.frames = 0;
+	if (ctx->current_mode)
+		ct3d_dimming_frame_setting(ctx, ctx->current_mode);
 }
 
 static int ct3d_panel_probe(struct mipi_dsi_device *dsi)
 {
 	struct ct3d_panel *spanel;
+	int ret;
 
 	spanel = devm_kzalloc(&dsi->dev, sizeof(*spanel), GFP_KERNEL);
 	if (!spanel)
 		return -ENOMEM;
 
 	spanel->is_hbm2_enabled = false;
-	return gs_dsi_panel_common_init(dsi, &spanel->base);
+	ct3_ffc_init(&dsi->dev, &spanel->ffc, ct3d_ffc_payloads, ARRAY_SIZE(ct3d_ffc_payloads),
+		     0x01);
+	spanel->dimming.duration_ms = CT3_DIMMING_MS;
+	of_property_read_u32(dsi->dev.of_node, "google,dimming-ms", &spanel->dimming.duration_ms);
+	ct3_te_init(&dsi->dev, &spanel->te);
+
+	ret = gs_dsi_panel_common_init(dsi, &spanel->base);
+	if (ret)
+		return ret;
+
+	if (of_property_read_bool(dsi->dev.of_node, "google,te-phase-lock")) {
+		spanel->te_sync.ctx = &spanel->base;
+		spanel->te_sync.te = &spanel->te;
+		spanel->te_sync.role = CT3_TE_SYNC_FOLLOWER;
+		spanel->te_sync.apply = ct3d_te_sync_apply;
+		ret = ct3_te_sync_register(&dsi->dev, &spanel->te_sync);
+		if (ret)
+			dev_warn(&dsi->dev, "TE phase lock unavailable (%d)\n", ret);
+	}
+
+	return 0;
 }
 
 static const struct drm_panel_funcs ct3d_drm_funcs = {
@@ -813,7 +913,7 @@ static int ct3d_panel_config(struct gs_panel *ctx);
 
 static const struct gs_panel_funcs ct3d_gs_funcs = {
 	.set_brightness = ct3d_set_brightness,
-	.set_lp_mode = gs_panel_set_lp_mode_helper,
+	.set_lp_mode = ct3d_set_lp_mode,
 	.set_nolp_mode = ct3d_set_nolp_mode,
 	.set_binned_lp = gs_panel_set_binned_lp_helper,
 	.set_hbm_mode = ct3d_set_hbm_mode,
@@ -910,6 +1010,8 @@ struct gs_panel_desc google_ct3d = {
 
 static int ct3d_panel_config(struct gs_panel *ctx)
 {
+	struct ct3d_panel *spanel = to_spanel(ctx);
+	struct ct3_dbv_zone zones[DBV_RANGE_MAX];
 	int ret;
 	/* b/300383405 Currently, we can't support multiple
 	 *  displays in `display_layout_configuration.xml`.
@@ -918,8 +1020,15 @@ static int ct3d_panel_config(struct gs_panel *ctx)
 
 	ret = gs_panel_update_brightness_desc(&ct3d_brightness_desc, ct3d_btr_configs,
 				  ARRAY_SIZE(ct3d_btr_configs), ctx->panel_rev);
+	if (ret)
+		return ret;
 
-	return ret;
+	memcpy(zones, ct3d_dbv_zones, sizeof(zones));
+	zones[DBV_HBM2].min_dbv = ct3d_brightness_desc.brt_capability->hbm.level.max;
+	ct3_dbv_zone_table_init(ctx->dev, &spanel->dbv_zones, zones, ARRAY_SIZE(zones),
+				CT3D_DBV_MAX);
+
+	return 0;
 }
 
 static const struct of_device_id gs_panel_of_match[] = {
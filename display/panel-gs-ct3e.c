@@ -18,6 +18,8 @@
 #include "gs_panel/gs_panel.h"
 #include "gs_panel/gs_panel_funcs_defaults.h"
 
+#include "panel-gs-ct3.h"
+
 /* DSC1.2 */
 static const struct drm_dsc_config pps_config = {
 	.line_buf_depth = 9,
@@ -157,9 +159,27 @@ struct ct3e_panel {
 	 *		  panel can recover to normal mode after entering pixel-off state.
 	 */
 	bool is_pixel_off;
+	/** @te: TE interrupt used to wait for the next frame on idle exit */
+	struct ct3_te te;
 };
 #define to_spanel(ctx) container_of(ctx, struct ct3e_panel, base)
 
+/* lowest rate the DDIC can run at outside of AOD */
+#define CT3E_IDLE_VREFRESH 60
+
+static void ct3e_write_frequency(struct gs_panel *ctx, u32 vrefresh)
+{
+	struct device *dev = ctx->dev;
+
+	GS_DCS_BUF_ADD_CMDLIST(dev, test_key_enable);
+	GS_DCS_BUF_ADD_CMD(dev, 0x83, (vrefresh == 120) ? 0x00 : 0x08);
+	GS_DCS_BUF_ADD_CMD(dev, 0xF7, 0x2F);
+	GS_DCS_BUF_ADD_CMDLIST_AND_FLUSH(dev, test_key_disable);
+
+	ctx->hw_status.vrefresh = vrefresh;
+	ctx->hw_status.te.rate_hz = vrefresh;
+}
+
 static void ct3e_change_frequency(struct gs_panel *ctx,
 				const struct gs_panel_mode *pmode)
 {
@@ -169,15 +189,79 @@ static void ct3e_change_frequency(struct gs_panel *ctx,
 	if (!ctx || (vrefresh != 60 && vrefresh != 120))
 		return;
 
-	GS_DCS_BUF_ADD_CMDLIST(dev, test_key_enable);
-	GS_DCS_BUF_ADD_CMD(dev, 0x83, (vrefresh == 120) ? 0x00 : 0x08);
-	GS_DCS_BUF_ADD_CMD(dev, 0xF7, 0x2F);
-	GS_DCS_BUF_ADD_CMDLIST_AND_FLUSH(dev, test_key_disable);
+	ct3e_write_frequency(ctx, vrefresh);
 
-	dev_info(dev, "%s: change to %uHz\n", __func__, vrefresh);
+	/* an explicit rate change always ends idle */
+	if (ctx->idle_data.panel_idle_vrefresh) {
+		ctx->idle_data.panel_idle_vrefresh = 0;
+		notify_panel_mode_changed(ctx);
+	}
+
+	dev_dbg(dev, "%s: change to %uHz\n", __func__, vrefresh);
+	ct3_log(ctx, CT3_LOG_FREQ, vrefresh, ctx->op_hz);
 	return;
 }
 
+static u32 ct3e_get_idle_vrefresh(struct gs_panel *ctx, const struct gs_panel_mode *pmode)
+{
+	const int vrefresh = drm_mode_vrefresh(&pmode->mode);
+
+	/* don't lower the rate during dimming, it would be visible */
+	if (!ctx->idle_data.panel_idle_enabled || ctx->dimming_on)
+		return 0;
+
+	if (ctx->idle_data.idle_delay_ms &&
+	    gs_panel_get_idle_time_delta(ctx) < ctx->idle_data.idle_delay_ms)
+		return 0;
+
+	if (ctx->min_vrefresh > CT3E_IDLE_VREFRESH || vrefresh <= CT3E_IDLE_VREFRESH)
+		return 0;
+
+	return CT3E_IDLE_VREFRESH;
+}
+
+/**
+ * ct3e_set_self_refresh - drop the refresh rate while the display is static
+ * @ctx: gs_panel struct
+ * @enable: self refresh is entered
+ *
+ * The DDIC has no panel driven frame insertion, so idle is handled by the
+ * driver: once the display goes static in a 120Hz mode, the panel is switched
+ * to 60Hz and the rate is reported through panel_idle_vrefresh. The mode rate
+ * is restored with the next frame.
+ *
+ * Return: true if the panel state was changed
+ */
+static bool ct3e_set_self_refresh(struct gs_panel *ctx, bool enable)
+{
+	const struct gs_panel_mode *pmode = ctx->current_mode;
+	u32 idle_vrefresh;
+
+	if (unlikely(!pmode))
+		return false;
+
+	if (pmode->gs_mode.is_lp_mode || pmode->idle_mode != GIDLE_MODE_ON_SELF_REFRESH)
+		return false;
+
+	idle_vrefresh = enable ? ct3e_get_idle_vrefresh(ctx, pmode) : 0;
+	if (ctx->idle_data.panel_idle_vrefresh == idle_vrefresh)
+		return false;
+
+	PANEL_ATRACE_BEGIN(__func__);
+	ct3e_write_frequency(ctx, idle_vrefresh ?: drm_mode_vrefresh(&pmode->mode));
+	ctx->idle_data.panel_idle_vrefresh = idle_vrefresh;
+	notify_panel_mode_changed(ctx);
+
+	/* the first frame after idle may still be scanned out at the idle rate */
+	if (!idle_vrefresh && ctx->idle_data.panel_need_handle_idle_exit)
+		ct3_wait_one_vblank(ctx, &to_spanel(ctx)->te);
+	PANEL_ATRACE_END(__func__);
+
+	dev_dbg(ctx->dev, "%s: idle_vrefresh=%u\n", __func__, idle_vrefresh);
+
+	return true;
+}
+
 static void ct3e_update_wrctrld(struct gs_panel *ctx)
 {
 	struct device *dev = ctx->dev;
@@ -302,6 +386,8 @@ static void ct3e_debugfs_init(struct drm_panel *panel, struct dentry *root)
 		if (!panel_root)
 			return;
 
+		ct3_dsi_prof_debugfs_init(panel_root);
+
 		csroot = debugfs_lookup("cmdsets", panel_root);
 		if (!csroot)
 			goto panel_out;
@@ -408,6 +494,7 @@ static int ct3e_panel_probe(struct mipi_dsi_device *dsi)
 		return -ENOMEM;
 
 	spanel->is_pixel_off = false;
+	ct3_te_init(&dsi->dev, &spanel->te);
 
 	return gs_dsi_panel_common_init(dsi, &spanel->base);
 }
@@ -466,6 +553,7 @@ static const struct gs_panel_mode_array ct3e_modes = {
 				.dsc = CT3E_DSC,
 				.underrun_param = &underrun_param,
 			},
+			.idle_mode = GIDLE_MODE_ON_SELF_REFRESH,
 		},
 	},
 };
@@ -544,6 +632,7 @@ static const struct gs_panel_funcs ct3e_gs_funcs = {
 	.set_hbm_mode = ct3e_set_hbm_mode,
 	.is_mode_seamless = gs_panel_is_mode_seamless_helper,
 	.mode_set = ct3e_mode_set,
+	.set_self_refresh = ct3e_set_self_refresh,
 	.get_panel_rev = ct3e_get_panel_rev,
 	.read_id = gs_panel_read_slsi_ddic_id,
 };
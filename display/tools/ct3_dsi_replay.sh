@@ -0,0 +1,160 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Replay the 120->1Hz idle, LP enter/exit and HBM on/off scenarios on a
+# device and compare the DSI traffic of each against a baseline.
+#
+# The panel and core modules must be built with CT3_DSI_PROFILE (see Makefile), the
+# device must be rooted and its screen on and unlocked.
+#
+#   ct3_dsi_replay.sh [options] compare <baseline>
+#   ct3_dsi_replay.sh [options] record <baseline>
+#
+# compare fails if any call site listed in the baseline sends more packets or
+# bytes than recorded there, or spends more than half again the recorded time
+# (plus 50us of slack) in DSI writes. Timings of "-" aren't checked, as in the
+# hand-derived ct3b.baseline.template. Call sites missing from the baseline are
+# printed but not checked, their traffic depends on state the scenario doesn't
+# pin down (shadowed registers, dimming, current refresh rate).
+
+usage() {
+  echo "usage: $0 [-s serial] [-c connector] [-b backlight] [-d brightness]" \
+    "compare|record <baseline>" >&2
+  exit 2
+}
+
+connector=
+backlight=panel0-backlight
+brightness=1024
+while getopts "s:c:b:d:" opt; do
+  case "${opt}" in
+    s) export ANDROID_SERIAL="${OPTARG}" ;;
+    c) connector="${OPTARG}" ;;
+    b) backlight="${OPTARG}" ;;
+    d) brightness="${OPTARG}" ;;
+    *) usage ;;
+  esac
+done
+shift $((OPTIND - 1))
+
+action=$1
+baseline=$2
+if [ $# -ne 2 ] || { [ "${action}" != compare ] && [ "${action}" != record ]; }; then
+  usage
+fi
+if [ "${action}" = compare ] && [ ! -f "${baseline}" ]; then
+  echo "${baseline}: no such baseline" >&2
+  exit 2
+fi
+
+adb root >/dev/null && adb wait-for-device || exit 1
+
+prof=$(adb shell "ls /sys/kernel/debug/dri/*/${connector:-*}/panel/dsi_profile" 2>/dev/null |
+  head -n 1 | tr -d '\r')
+if [ -z "${prof}" ]; then
+  echo "no dsi_profile in debugfs, are the modules built with CT3_DSI_PROFILE?" >&2
+  exit 1
+fi
+bl=/sys/class/backlight/${backlight}
+
+run() {
+  adb shell "$@" >/dev/null
+}
+
+# reset and start recording
+prof_start() {
+  run "echo r > ${prof} && echo 1 > ${prof}"
+}
+
+# stop recording and print "<scenario> <function> <packets> <bytes> <flushes> <time_us>"
+prof_stop() {
+  run "echo 0 > ${prof}"
+  adb shell "cat ${prof}" | tr -d '\r' |
+    awk -v s="$1" 'NR > 2 && $1 != "total" { print s, $1, $2, $3, $4, $7 }'
+}
+
+# settle at the peak rate, then keep the screen static while the panel idles down to 1Hz
+scenario_idle() {
+  run "settings put system peak_refresh_rate 120"
+  run "input tap 1 1"
+  sleep 1
+  prof_start
+  sleep 5
+  prof_stop idle
+}
+
+# enter and leave AOD
+scenario_lp() {
+  run "settings put secure doze_always_on 1"
+  prof_start
+  run "input keyevent KEYCODE_SLEEP"
+  sleep 3
+  run "input keyevent KEYCODE_WAKEUP"
+  sleep 2
+  prof_stop lp
+}
+
+# HBM with IRC off and back, below the HBM2 brightness so no ELVSS update precedes it
+scenario_hbm() {
+  run "echo ${brightness} > ${bl}/brightness"
+  sleep 1
+  prof_start
+  run "echo 2 > ${bl}/hbm_mode"
+  sleep 1
+  run "echo 0 > ${bl}/hbm_mode"
+  sleep 1
+  prof_stop hbm
+}
+
+results=$(mktemp)
+trap '{ rm -f -- "${results}"; }' EXIT
+
+run "input keyevent KEYCODE_WAKEUP"
+sleep 1
+for s in idle lp hbm; do
+  "scenario_${s}" >> "${results}" || exit 1
+done
+
+if [ "${action}" = record ]; then
+  {
+    echo "# DSI traffic per scenario, recorded by $(basename "$0")"
+    echo "# scenario function packets bytes flushes time_us"
+    cat "${results}"
+  } > "${baseline}"
+  echo "recorded $(wc -l < "${results}") call sites to ${baseline}"
+  exit 0
+fi
+
+awk '
+  FNR == NR {
+    if ($1 !~ /^#/ && NF == 6) {
+      key = $1 " " $2
+      base_pkts[key] = $3
+      base_bytes[key] = $4
+      base_time[key] = $6
+    }
+    next
+  }
+  {
+    key = $1 " " $2
+    seen[key] = 1
+    if (!(key in base_pkts)) {
+      printf "%-6s %-40s %6u pkts %8u bytes %6u us (not in baseline)\n", $1, $2, $3, $4, $6
+      next
+    }
+    status = "ok"
+    if ($3 > base_pkts[key] || $4 > base_bytes[key] ||
+        (base_time[key] != "-" && $6 > base_time[key] * 3 / 2 + 50)) {
+      status = "REGRESSED"
+      failed = 1
+    }
+    printf "%-6s %-40s %6u pkts %8u bytes %6u us (baseline %u/%u/%s) %s\n", $1, $2, $3, $4,
+      $6, base_pkts[key], base_bytes[key], base_time[key], status
+  }
+  END {
+    for (key in base_pkts)
+      if (!(key in seen))
+        printf "%-40s no traffic (baseline %u/%u)\n", key, base_pkts[key], base_bytes[key]
+    exit failed
+  }
+' "${baseline}" "${results}"